@@ -25,138 +25,221 @@ Ver		Date		Description
 					Made the assembler print out errors to stderr as well
 					as the listing file. NPM.
 
-This file contains the main program and line assembly routines for the
-assembler.  The main program parses the command line, feeds the source lines to
-the line assembly routine, and sends the results to the listing and object file
-output routines.  It also coordinates the activities of everything.  The line
+This file contains the main routine and line assembly routines for the
+assembler.  The main routine sets up an assembly from its context, feeds the
+source lines to the line assembly routine, and sends the results to the listing
+and object file output routines.  It also coordinates the activities of everything.  The line
 assembly routines uses the expression analyzer and the lexical analyzer to
 parse the source line and convert it into the object bytes that it represents.
 */
 
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <ctype.h>
+#include <setjmp.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#ifndef __STDC_NO_THREADS__
+#include <threads.h>
+#endif
 
 /*  Get global goodies:  */
 
 #include "a65.h"
 #include "a65eval.h"
 #include "a65util.h"
+#include "a65n.h"
 
 /*  Define global mailboxes for all modules:				*/
 
-char errcode, line[MAXLINE + 1], title[MAXLINE];
+THREAD char errcode, line[MAXLINE + 1], title[MAXLINE];
 /* the name of the base directory that should be prepended to every INCL/INCB filename in the source */
-char basedir[MAXLINE];
+THREAD char basedir[MAXLINE];
 /* the name of the last global label parsed by the program */
-char lastglobal[MAXLINE];
-int pass = 0;
-int eject, filesp, forwd, forceabs, listhex;
-unsigned address, argattr, bytes, errors, listleft, obj[65536], pagelen, pc;
-FILE_INFO filestk[FILES];
-FILE *source;
-TOKEN token;
+THREAD char *lastglobal = "";
+THREAD int pass = 0;
+/* single-pass mode: forward references are fixed up after the last line */
+THREAD int onepass = FALSE;
+/* set for the pass that writes the object, listing, and messages */
+THREAD int lastpass;
+/* fixok lets lex() accept forward references in single-pass mode, and	*/
+/* unresolved reports that it did */
+THREAD int fixok = FALSE, unresolved;
+/* relocatable mode: the object holds sections, and reloc and sect are */
+/* the bases (see RELBASE) of the last expression and of the location counter */
+THREAD int relocate = FALSE;
+THREAD unsigned reloc = 0, sect = 0;
+/* the PROC block being assembled, 0 outside one, or NOPROC while */
+/* reading a label that shouldn't keep its block */
+THREAD unsigned inproc = 0;
+/* replay is set while pass 2 replays the token cache from lexline */
+THREAD int replay = FALSE;
+THREAD LINEREC *lexline = NULL;
+/* set in the threads that assemble runs of pass 2's lines ahead of it */
+THREAD int worker = FALSE;
+THREAD int eject, filesp, forwd, forceabs, listhex;
+THREAD unsigned address, argattr, bytes, errors, listleft, obj[65536], pagelen, pc;
+THREAD FILE_INFO filestk[FILES], *source;
+THREAD TOKEN token;
+/* the context of the assembly running, and where fatal_error() goes */
+THREAD A65CTX *ctx = NULL;
+THREAD jmp_buf *bailout = NULL;
 
 /* Static function definitions: */
 static void asm_line();
-static void flush();
 static void do_label();
 static void normal_op();
 static void pseudo_op();
-
-/*  Mainline routine.  This routine parses the command line, sets up	*/
-/*  the assembler at the beginning of each pass, feeds the source text	*/
-/*  to the line assembler, feeds the result to the listing and hex file	*/
-/*  drivers, and cleans everything up at the end of the run.		*/
-
-static int done, ifsp, off;
-
-int main(int argc, char **argv) {
+static void save_fields(int hasop);
+static void save(PSTATE *p);
+static void restore(PSTATE *p);
+static int same(PSTATE *p);
+static void snap();
+static void farm();
+#ifndef __STDC_NO_THREADS__
+static int runner(void *arg);
+static void part(RUNREC *r);
+static int alone();
+#endif
+static void passed(SYMBOL *l);
+static int take_run();
+static void endfarm();
+static FIXUP *fixup(unsigned kind, unsigned pos, unsigned index);
+static void refix(FIXUP *f);
+static void save_fixups();
+static void resolve();
+static unsigned relocation(unsigned kind, unsigned long offset, unsigned u);
+
+/*  Mainline routine.  This routine sets up the assembler from the	*/
+/*  context, sets it up again at the beginning of each pass, feeds the	*/
+/*  source text to the line assembler, feeds the result to the listing	*/
+/*  and hex file drivers, and cleans everything up at the end of the	*/
+/*  run.  A fatal error comes back here through bailout.		*/
+
+static THREAD int done, ifsp, off;
+static THREAD char label[MAXLINE];
+static THREAD int ifstack[IFDEPTH];
+static THREAD FIXUP *fixups, **fixtail, *fixline;
+/* the section being assembled into in relocatable mode */
+static THREAD unsigned section;
+/* inside a PROC block, inside one that was dropped, and a line of one */
+/* that's left out of the listing */
+static THREAD int block, dead, hidden;
+/* DATE's time: the context's epoch, or else the time the DATE is */
+/* assembled, which sets dated so the outputs aren't cached */
+static THREAD time_t time_data;
+static THREAD int dated;
+/* the states pass 1 saved for the pass 2 workers (see RUNREC) */
+static THREAD PSTATE *snaps = NULL;
+static THREAD unsigned long nsnaps = 0, snapsize = 0;
+
+int a65n_assemble(A65CTX *c) {
     SCRATCH unsigned *o;
-
-	printf("6502 Cross-Assembler (Portable)\n");
-	printf("Copyright (c) 1986 William C. Colley, III\n");
-	printf("Copyright (c) 2023-2025 Nathan Misner\n\n");
-
-    while (--argc > 0) {
-		if (**++argv == '-') {
-			switch (toupper(*++*argv)) {
-			case 'B':
-				if (!*++*argv) {
-					if (!--argc) { warning(NODIR);  break; }
-					else ++argv;
-				}
-				strcpy(basedir, *argv);
-				break;
-
-			case 'E':
-				if (!*++*argv) {
-					if (!--argc) { warning(NOEXP);  break; }
-					else ++argv;
-				}
-				eopen(*argv);
-				break;
-
-			case 'L':   
-				if (!*++*argv) {
-					if (!--argc) { warning(NOLST);  break; }
-					else ++argv;
-				}
-				lopen(*argv);
-				break;
-
-			case 'O':
-				if (!*++*argv) {
-					if (!--argc) { warning(NOHEX);  break; }
-					else ++argv;
-				}
-				bopen(*argv);
-				break;
-
-			default:
-				warning(BADOPT);
-			}
-		}
-		else if (filestk[0].fp) warning(TWOASM);
-		else {
-			filestk[0].fp = fopen(*argv, "r");
-			if (!filestk[0].fp) {
-				fatal_error(ASMOPEN);
-			}
-			strcpy(filestk[0].filename, *argv);
-			filestk[0].linenum = 0;
+    SCRATCH char *s;
+    jmp_buf bail;
+
+    ctx = c;  ctx -> image = NULL;  ctx -> size = 0;
+    ctx -> diag = NULL;  ctx -> diaglen = 0;
+    ctx -> errors = 0;  ctx -> fatal = NULL;
+    ctx -> deps = ctx -> missing = NULL;  ctx -> depslen = ctx -> missinglen = 0;
+    if (setjmp(bail)) {
+		if (ctx -> keepdeps) {
+			ctx -> deps = sdeps(&ctx -> depslen);
+			ctx -> missing = smissing(&ctx -> missinglen);
 		}
+		endfarm();  endlex();  endutil();  bailout = NULL;  ctx = NULL;
+		return -1;
+    }
+    bailout = &bail;
+
+    pass = 0;  onepass = ctx -> onepass;  fixok = replay = FALSE;
+    relocate = ctx -> relocate && !ctx -> snapshot;
+    lastglobal = "";  lexline = NULL;  ifstack[0] = ON;
+    token.sval = token.sbuf;  token.sym = NULL;
+    fixups = fixline = NULL;  fixtail = &fixups;
+    memset(filestk,0,sizeof(filestk));
+    strcpy(basedir,ctx -> basedir ? ctx -> basedir : "");
+    dated = FALSE;
+    if (ctx -> epoch) {
+		time_data = (time_t)strtoll(ctx -> epoch,&s,10);
+		if (!*ctx -> epoch || *s) fatal_error(BADDATE);
     }
-    if (!filestk[0].fp) fatal_error(NOASM);
 
-    while (++pass < 3) {
-		fseek(source = filestk[0].fp,0L,0);  done = off = FALSE;
+    if (!ctx -> source) fatal_error(NOASM);
+    if (ctx -> text) a65n_source(ctx -> source,ctx -> text,ctx -> len);
+    if (!(filestk[0].sf = sopen(ctx -> source,FALSE))) fatal_error(ASMOPEN);
+    strcpy(filestk[0].filename,ctx -> source);
+    if (ctx -> cache && !ctx -> snapshot && cfetch()) { errors = 0;  goto cached; }
+    sreadahead(filestk[0].sf);
+    if (ctx -> export) eopen(ctx -> export);
+    if (ctx -> listing) lopen(ctx -> listing);
+    if (ctx -> object) bopen(ctx -> object);
+    if (onepass) lhold();
+    if (onepass || ctx -> keepimage || ctx -> cache || ctx -> snapshot || relocate) bhold();
+
+    while (++pass < (onepass ? 2 : 3)) {
+		lastpass = onepass || pass == 2;
+		startpass();  done = off = FALSE;
+		if (pass == 2) farm();
+		else nsnaps = 0;
 		filestk[0].linenum = 0;
-		errors = filesp = ifsp = pagelen = pc = 0;  title[0] = '\0';
+		errors = filesp = ifsp = pagelen = pc = sect = inproc = 0;  title[0] = '\0';
+		lastglobal = "";  block = dead = FALSE;
+		if (relocate) { rstart();  sect = rswitch(section = rsect(DEFSECT),&pc); }
 		while (!done) {
+			if (pass == 1) snap();
+			else if (take_run()) continue;
 			errcode = ' ';
 			if (newline()) {
-				error('*');
+				if (!ctx -> snapshot) error('*');
 				strcpy(line,"\tEND\n");
-				done = eject = TRUE;  listhex = FALSE;
+				done = eject = TRUE;  listhex = hidden = FALSE;
 				bytes = 0;
 			}
 			else asm_line();
 			pc = word(pc + bytes);
-			if (pass == 2) {
-				lputs();
+			if (lastpass) {
+				if (!hidden) lputs();
 				for (o = obj; bytes--; bputc(*o++));
 			}
 		}
+		/* pass 1 again, without the PROC blocks nothing reaches */
+		if (pass == 1 && !onepass && prune()) { forget();  endlex();  pass = 0; }
     }
+    if (onepass) resolve();
+    endfarm();
 
-	fclose(filestk[0].fp);  eclose();  lclose();  bclose();
+	eclose();  lclose();  bclose();
+    if (ctx -> snapshot) {
+		if (btell() || pc) fatal_error(NOTEQU);
+		if (!errors) swrite();
+    }
+    else if (ctx -> cache && !errors && !dated) cstore();
+
+cached:
+    if (ctx -> depfile) dwrite(ctx -> depfile);
+    if (ctx -> keepimage) ctx -> image = btake(&ctx -> size);
+    if (ctx -> keepdeps) {
+		ctx -> deps = sdeps(&ctx -> depslen);
+		ctx -> missing = smissing(&ctx -> missinglen);
+    }
 
-    if (errors) printf("%d Error(s)\n",errors);
-    else printf("No Errors\n");
+    ctx -> errors = errors;
+    endlex();  endutil();  bailout = NULL;  ctx = NULL;
+    return errors;
+}
 
-    exit(errors);
+/*  Free what a65n_assemble() left in the context.			*/
+
+void a65n_release(A65CTX *c) {
+    free(c -> image);  c -> image = NULL;  c -> size = 0;
+    free(c -> diag);  c -> diag = NULL;  c -> diaglen = 0;
+    free(c -> deps);  c -> deps = NULL;  c -> depslen = 0;
+    free(c -> missing);  c -> missing = NULL;  c -> missinglen = 0;
+    return;
 }
 
 /*  Line assembly routine.  This routine gets the contents of the	*/
@@ -165,10 +248,7 @@ int main(int argc, char **argv) {
 /*  arguments validity, fills a buffer with the machine code bytes and	*/
 /*  returns nothing.							*/
 
-static char label[MAXLINE];
-static int ifstack[IFDEPTH] = { ON };
-
-static OPCODE *opcod;
+static THREAD OPCODE *opcod;
 
 static void asm_line() {
     SCRATCH int i;
@@ -176,28 +256,46 @@ static void asm_line() {
     address = pc;  bytes = 0;  eject = forwd = forceabs = listhex = FALSE;
     for (i = 0; i < BIGINST; obj[i++] = NOP);
 
-    label[0] = '\0';
-    if ((i = popc()) != ' ' && i != '\n') {
-		if (isalph(i)) {
-			pushc(i);  pops(label);
-			if (find_operator(label)) { label[0] = '\0';  error('L'); }
-		}
-		else {
-			error('L');
-			while ((i = popc()) != ' ' && i != '\n');
+    label[0] = '\0';  hidden = FALSE;
+    if ((off || dead) && !replay && skipline()) {
+		if (lexline) { lexline -> ferr = ' ';  lexline -> untok = TRUE; }
+		listhex = FALSE;  hidden = dead;  return;
+    }
+    if (replay) {
+		if (lexline -> label) strcpy(label,lexline -> label);
+		if (lexline -> ferr != ' ') error(lexline -> ferr);
+		if (!(opcod = lexline -> opcod) && lexline -> hasop) {
+			listhex = TRUE;  bytes = BIGINST;
 		}
     }
+    else {
+		if ((i = popc()) != ' ' && i != '\n') {
+			if (isalph(i)) {
+				pushc(i);  pops(label);
+				if (find_operator(label)) { label[0] = '\0';  error('L'); }
+			}
+			else {
+				error('L');
+				while ((i = popc()) != ' ' && i != '\n');
+			}
+		}
 
-    trash();  opcod = NULL;
-    if ((i = popc()) != '\n') {
-		if (!isalph(i)) error('S');
-		else {
-			pushc(i);  pops(token.sval);
-			if (!(opcod = find_code(token.sval))) error('O');
+		trash();  opcod = NULL;
+		if ((i = popc()) != '\n') {
+			if (!isalph(i)) error('S');
+			else {
+				pushc(i);  pops(token.sbuf);
+				if (!(opcod = find_code(token.sbuf))) error('O');
+			}
+			if (!opcod) { listhex = TRUE;  bytes = BIGINST; }
 		}
-		if (!opcod) { listhex = TRUE;  bytes = BIGINST; }
+		if (lexline) save_fields(i != '\n');
     }
 
+    if (dead && !(opcod && opcod -> attr & PSEUDO &&
+		(opcod -> valu == ENDPROC || opcod -> valu == END))) {
+		listhex = FALSE;  hidden = TRUE;  bytes = 0;  flush();  return;
+    }
     if (opcod && opcod -> attr & ISIF) { if (label[0]) error('L'); }
     else if (off) { listhex = FALSE;  flush();  return; }
 
@@ -206,17 +304,226 @@ static void asm_line() {
 		listhex = TRUE;
 		if (opcod -> attr & PSEUDO) pseudo_op();
 		else normal_op();
-		while ((i = popc()) != '\n') if (i != ' ') error('T');
+		endline();
+    }
+    save_fixups();
+    source = filestk + filesp;
+    return;
+}
+
+/*  Save the label and opcode fields of the line in the token cache.	*/
+
+static void save_fields(int hasop) {
+    if (label[0]) lexline -> label = intern(label);
+    lexline -> opcod = opcod;  lexline -> ferr = errcode;
+    lexline -> hasop = hasop;  lexline -> argpos = linepos();
+    return;
+}
+
+/*  Pass 2 worker routines (see RUNREC in A65.H).  snap() saves the	*/
+/*  line assembler's state every PARLINES lines of pass 1, and farm()	*/
+/*  sets the workers going on the runs between the saved states before	*/
+/*  pass 2 starts, if the context asks for threads.  take_run() hands	*/
+/*  pass 2 the output of a run when it gets to the run's start.		*/
+
+static THREAD LEXCACHE lent;
+static THREAD SYMTAB slent;
+static THREAD RUNREC *runs = NULL;
+static THREAD unsigned long nruns = 0, rcur;
+static THREAD SYMBOL **defs = NULL;
+static THREAD unsigned long ndefs, defsize = 0;
+
+static void save(PSTATE *p) {
+    p -> pc = pc;  p -> inproc = inproc;  p -> lastglobal = lastglobal;
+    p -> off = off;  p -> block = block;  p -> dead = dead;
+    p -> ifsp = ifsp;  memcpy(p -> ifstack,ifstack,sizeof(ifstack));
+    return;
+}
+
+static void restore(PSTATE *p) {
+    pc = p -> pc;  inproc = p -> inproc;  lastglobal = p -> lastglobal;
+    off = p -> off;  block = p -> block;  dead = p -> dead;
+    ifsp = p -> ifsp;  memcpy(ifstack,p -> ifstack,sizeof(ifstack));
+    return;
+}
+
+static int same(PSTATE *p) {
+    return p -> pc == pc && p -> inproc == inproc && p -> off == off &&
+		p -> block == block && p -> dead == dead && p -> ifsp == ifsp &&
+		!memcmp(p -> ifstack,ifstack,(ifsp + 1) * sizeof(int)) &&
+		!strcmp(p -> lastglobal,lastglobal);
+}
+
+static void snap() {
+    SCRATCH PSTATE *p;
+
+    if (onepass || relocate || ctx -> threads < 2 || lextell() != nsnaps * PARLINES)
+		return;
+    if (nsnaps == snapsize) {
+		snapsize = snapsize ? snapsize * 2 : 64;
+		if (!(p = (PSTATE *)realloc(snaps,snapsize * sizeof(PSTATE))))
+			fatal_error(MEMFULL);
+		snaps = p;
+    }
+    save(snaps + nsnaps++);
+    return;
+}
+
+static void farm() {
+#ifndef __STDC_NO_THREADS__
+    SCRATCH unsigned i, n;
+    SCRATCH RUNREC *r;
+    WORKER *wv;
+    thrd_t *tv;
+
+    rcur = 0;  wv = NULL;  tv = NULL;
+    if (onepass || relocate || (n = ctx -> threads) < 2 || nsnaps < 2) return;
+    if (n > nsnaps) n = nsnaps;
+    lexlend(&lent);  symlend(&slent);
+    if (!(runs = (RUNREC *)calloc(nsnaps,sizeof(RUNREC))) ||
+		!(wv = (WORKER *)malloc(n * sizeof(WORKER))) ||
+		!(tv = (thrd_t *)malloc(n * sizeof(thrd_t)))) fatal_error(MEMFULL);
+    for (nruns = 0; nruns < nsnaps; ++nruns) {
+		r = runs + nruns;  r -> start = snaps[nruns];
+		r -> first = r -> stop = nruns * PARLINES;
+		r -> last = nruns + 1 < nsnaps ? r -> first + PARLINES : lent.nlines;
+    }
+    for (i = 0; i < n; ++i) {
+		wv[i].runs = runs + i;  wv[i].nruns = (nruns - i + n - 1) / n;  wv[i].step = n;
+		wv[i].lex = &lent;  wv[i].syms = &slent;  wv[i].listing = ctx -> listing != NULL;
+		if (thrd_create(tv + i,runner,wv + i) != thrd_success) break;
+    }
+    for (n = i, i = 0; i < n; ++i) thrd_join(tv[i],NULL);
+    free(wv);  free(tv);
+#endif
+    return;
+}
+
+#ifndef __STDC_NO_THREADS__
+
+/*  Worker thread.  It assembles every step-th run, starting with its	*/
+/*  first, as pass 2 would.						*/
+
+static int runner(void *arg) {
+    SCRATCH unsigned long i;
+    SCRATCH WORKER *w;
+
+    w = (WORKER *)arg;
+    lexborrow(w -> lex);  symborrow(w -> syms);
+    pass = 2;  lastpass = replay = worker = TRUE;
+    onepass = relocate = fixok = FALSE;
+    sect = reloc = pagelen = 0;  title[0] = '\0';
+    token.sval = token.sbuf;  token.sym = NULL;
+    bhold();
+    if (w -> listing) lkeep();
+    for (i = 0; i < w -> nruns; ++i) part(w -> runs + i * w -> step);
+    return 0;
+}
+
+/*  Assembles run r quietly, line by line, until a line can't be	*/
+/*  assembled by a worker.  Where it got to, and how much output it had	*/
+/*  then, is marked at the start of each line, so that a line a fatal	*/
+/*  error or handback() cuts short leaves nothing behind.		*/
+
+static void part(RUNREC *r) {
+    SCRATCH unsigned long n;
+    SCRATCH size_t len;
+    SCRATCH unsigned *o;
+    A65CTX quiet = { NULL };
+    jmp_buf bail;
+
+    ctx = &quiet;  errors = 0;  ndefs = 0;
+    restore(&r -> start);  lexseek(r -> first);
+    if (!setjmp(bail)) {
+		bailout = &bail;
+		for (n = r -> first; ; ++n) {
+			save(&r -> end);  r -> stop = n;  r -> ncode = btell();
+			r -> nrows = lkept();  r -> diaglen = quiet.diaglen;
+			r -> errors = errors;  r -> ndefs = ndefs;
+			if (n == r -> last) break;
+			errcode = ' ';  newline();
+			if (!alone()) break;
+			asm_line();
+			pc = word(pc + bytes);
+			if (!hidden) lputs();
+			for (o = obj; bytes--; bputc(*o++));
+		}
     }
-    source = filestk[filesp].fp;
+    bailout = NULL;  ctx = NULL;
+    r -> code = btake(&n);  r -> rows = ltake(&len);
+    r -> diag = quiet.diag;  r -> defs = defs;
+    defs = NULL;  defsize = 0;
     return;
 }
 
-static void flush() {
-    while (popc() != '\n');
+/*  Tells whether the line a worker has just read can be assembled	*/
+/*  apart from the lines before it, with no output but its listing	*/
+/*  rows, object bytes, and error lines.  A line skipped by pass 1 is	*/
+/*  only read again if it's skipped this time too.			*/
+
+static int alone() {
+    SCRATCH OPCODE *o;
+
+    if (!lexalone()) return lexline -> untok && (off || dead);
+    if (!(o = lexline -> opcod) || !(o -> attr & PSEUDO)) return TRUE;
+    switch (o -> valu) {
+	case DATE:	case END:	case EXP:	case INCB:	case INCL:
+	case MSG:	case PAGE:	case SET:	case TITL:	return FALSE;
+    }
+    return TRUE;
 }
 
-static char labelname[MAXLINE * 2];
+#endif
+
+/*  Keeps label l, whose definition a worker has passed, for take_run()	*/
+/*  to mark as defined.							*/
+
+static void passed(SYMBOL *l) {
+    SCRATCH SYMBOL **p;
+
+    if (ndefs == defsize) {
+		defsize = defsize ? defsize * 2 : 256;
+		if (!(p = (SYMBOL **)realloc(defs,defsize * sizeof(SYMBOL *))))
+			fatal_error(MEMFULL);
+		defs = p;
+    }
+    defs[ndefs++] = l;
+    return;
+}
+
+/*  Takes the output of the run pass 2 is at the start of, if a worker	*/
+/*  assembled it from the state pass 2 is in.  Returns FALSE if the	*/
+/*  next line has to be assembled after all.				*/
+
+static int take_run() {
+    SCRATCH RUNREC *r;
+    SCRATCH unsigned long i;
+
+    if (rcur == nruns || lextell() != (r = runs + rcur) -> first) return FALSE;
+    ++rcur;
+    if (r -> stop == r -> first || !same(&r -> start)) return FALSE;
+    lmerge(r -> rows,r -> nrows);
+    bwrite(r -> code,r -> ncode);
+    if (r -> diaglen) say(TRUE,"%.*s",(int)r -> diaglen,r -> diag);
+    errors += r -> errors;
+    for (i = 0; i < r -> ndefs; ++i) r -> defs[i] -> attr = VAL;
+    restore(&r -> end);  lexseek(r -> stop);
+    return TRUE;
+}
+
+/*  Gives back what the workers and snap() left.			*/
+
+static void endfarm() {
+    SCRATCH unsigned long i;
+
+    for (i = 0; i < nruns; ++i) {
+		free(runs[i].rows);  free(runs[i].diag);
+		free(runs[i].code);  free(runs[i].defs);
+    }
+    free(runs);  free(snaps);
+    runs = NULL;  snaps = NULL;  nruns = nsnaps = snapsize = 0;
+    return;
+}
 
 static void do_label() {
     SCRATCH SYMBOL *l;
@@ -235,26 +542,24 @@ static void do_label() {
 		}
 
 		/* handle local labels */
-		if (label[0] == '.') {
-			strcpy(labelname, lastglobal);
-			strcat(labelname, label);
-		}
-		else {
-			strcpy(lastglobal, label);
-			strcpy(labelname, label);
-		}
+		if (label[0] != '.') lastglobal = intern(label);
 
 		if (pass == 1) {
-			/* add the label to the symbol tree */
-			if (!((l = new_symbol(labelname)) -> attr)) {
+			/* add the label to the symbol table */
+			if (!((l = label[0] == '.' ? new_local(lastglobal, label) :
+				new_symbol(lastglobal)) -> attr)) {
 				l -> attr = FORWD + VAL;
-				l -> valu = pc;
+				l -> valu = pc;  l -> rel = sect;  l -> proc = inproc;
+				settle(l);
 			}
+			else if (onepass) error('M');
 		}
 		else {
-			if ((l = find_symbol(labelname))) {
-				l -> attr = VAL;
-				if (l -> valu != pc) error('M');
+			if ((l = label[0] == '.' ? find_local(lastglobal, label) :
+				find_symbol(lastglobal))) {
+				if (worker) passed(l);
+				else l -> attr = VAL;
+				if (l -> valu != pc || l -> rel != sect) error('M');
 			}
 			else error('P');
 		}
@@ -262,113 +567,97 @@ static void do_label() {
 }
 
 static void normal_op() {
-    SCRATCH unsigned opcode, operand;
-
-    opcode = opcod -> valu;  bytes = BIGINST;
-    do_label();  operand = do_args();
-    switch (opcod -> attr) {
-	case CPXY:  
-		if (argattr & ARGIMM) goto do_immediate;
-		opcode += 0x04;
-
-	case BITOP: 
-		if (argattr != ARGNUM) { error('A');  return; }
-	    goto do_zero_page;
-
-	case INHOP:
+    SCRATCH unsigned mode, zmode, operand, pos;
+    SCRATCH ENCODING *e;
+
+    e = (ENCODING *)opcod;  bytes = BIGINST;
+    do_label();  pos = linepos();
+    fixok = onepass;  unresolved = FALSE;
+    operand = do_args();  fixok = FALSE;
+    if (unresolved) operand = 0;
+    if (reloc) forceabs = TRUE;
+    switch (argattr) {
+	case 0:						mode = AM_IMP;	break;
+	case ARGA:					mode = AM_ACC;	break;
+	case ARGIMM + ARGNUM:		mode = AM_IMM;	break;
+	case ARGNUM:				mode = AM_ABS;	break;
+	case ARGX + ARGNUM:			mode = AM_ABX;	break;
+	case ARGY + ARGNUM:			mode = AM_ABY;	break;
+	case ARGIND + ARGNUM:		mode = AM_IND;	break;
+	case ARGIND + ARGX + ARGNUM:	mode = AM_INX;	break;
+	case ARGIND + ARGY + ARGNUM:	mode = AM_INY;	break;
+	default:					mode = AM_BAD;	break;
+    }
+    if (e -> cyc[AM_IMP]) {
 		if (argattr) error('T');
-	    bytes = 1;  break;
-
-	case JUMP:  
-		if (argattr == (ARGIND + ARGNUM)) {
-			opcode += 0x20;  break;
-		}
-
-	case CALL:  
-		if (argattr != ARGNUM) { error('A');  return; }
-		break;
-
-	case LOGOP: 
-		if (!(argattr & ARGA)) goto do_inc_op;
-	    opcode += 0x04;  bytes = 1;  break;
-
-	case RELBR: 
-		if (argattr != ARGNUM) { error('A');  return; }
-	    bytes = 2;  operand -= pc + 2;
-		if (clamp(operand) > 0x007f && operand < 0xff80) {
-			error('B');  operand = 0xfffe;
-		}
-		break;
+		mode = AM_IMP;
+    }
+    else if (mode == AM_ABS && e -> cyc[AM_REL]) mode = AM_REL;
+    else if (mode >= AM_ABS && mode <= AM_ABY) {
+		zmode = mode - AM_ABS + AM_ZP;
+		if (e -> cyc[zmode] && (!e -> cyc[mode] ||
+			(!forceabs && !forwd && operand <= 0x00ff))) mode = zmode;
+    }
+    if (mode == AM_BAD || !e -> cyc[mode]) { error('A');  return; }
 
-	case STXY:  
-		if ((argattr & (opcode == 0x86 ? ~ARGY : ~ARGX)) != ARGNUM) { 
-			error('A');
-			return;
-		}
-		if (argattr & (ARGX + ARGY)) {
-			if (operand > 0x00ff) {	error('V');  operand = 0; }
-			opcode += 0x10;  bytes = 2;  break;
-		}
-		goto do_zero_page;
+    switch (mode) {
+	case AM_IMP:
+	case AM_ACC:	bytes = 1;  break;
 
-	case TWOOP: 
-		if (!(argattr & ARGNUM)) { error('A');  return; }
-		if (argattr & ARGIMM) {
-			if (opcode == 0x81) { error('A');  return; }
-			opcode += 0x08;  goto do_immediate;
-		}
-		if (argattr & ARGIND) {
-			if (argattr & ARGY) opcode += 0x10;
-			else if (!(argattr & ARGX)) { error('A');  return; }
-			if (operand > 0x00ff) { error('V');  operand = 0; }
-			bytes = 2;
-		}
-		else if (argattr & ARGY) opcode += 0x18;
-		else { opcode += 0x04;  goto do_indexed_x; }
-		break;
+	case AM_IMM:	if (reloc) operand = relocation(FIXBYTE,btell() + 1,operand);
+					else if (operand > 0x00ff && operand < 0xff80) {
+						error('V');  operand = 0;
+					}
+					bytes = 2;  break;
+
+	case AM_ZP:
+	case AM_ZPX:
+	case AM_ZPY:
+	case AM_INX:
+	case AM_INY:	if (reloc) operand = relocation(FIXZP,btell() + 1,operand);
+					else if (operand > 0x00ff) { error('V');  operand = 0; }
+					bytes = 2;  break;
+
+	case AM_REL:	if (reloc != sect && !unresolved) {
+						operand = relocation(FIXREL,btell() + 1,operand);
+					}
+					else {
+						operand -= pc + 2;
+						if (!unresolved && clamp(operand) > 0x007f &&
+							operand < 0xff80) {
+							error('B');  operand = 0xfffe;
+						}
+					}
+					bytes = 2;  break;
 
-	case LDXY:
-		if (!(argattr & ARGIMM)) {
-			if (opcode == 0xa2 && (argattr & ARGY))
-				argattr ^= (ARGX + ARGY);
-			opcode += 0x04;  goto do_inc_op;
-		}
-do_immediate:
-		if (operand > 0x00ff && operand < 0xff80) {
-			error('V');  operand = 0;
-		}
-		bytes = 2;  break;
-
-do_inc_op:
-	case INCOP: 
-		if ((argattr & ~ARGX) != ARGNUM) { error('A');  return; }
-do_indexed_x:
-		if (argattr & ARGX) opcode += 0x10;
-do_zero_page:
-		if (!forceabs && !forwd && (operand <= 0x00ff)) bytes = 2;
-		else opcode += 0x08;
-		break;
+	default:		if (reloc) operand = relocation(FIXWORD,btell() + 1,operand);
+					bytes = 3;  break;
+    }
+    obj[2] = high(operand);  obj[1] = low(operand);  obj[0] = e -> op[mode];
+    if (unresolved && bytes > 1) {
+		if (mode == AM_REL) fixup(FIXARG + FIXREL, pos, 1);
+		else if (bytes == 3) fixup(FIXARG + FIXWORD, pos, 1);
+		else fixup(FIXARG + (mode == AM_IMM ? FIXBYTE : FIXZP), pos, 1);
     }
-    obj[2] = high(operand);  obj[1] = low(operand);  obj[0] = opcode;
     return;
 }
 
-static time_t time_data;
-static struct tm *localtime_data;
-static char date_buff[80];
-static char filename_buff[MAXLINE * 2 + 1];
+static THREAD struct tm localtime_data;
+static THREAD char date_buff[80];
+static THREAD char filename_buff[MAXLINE * 2 + 1];
 
 static void pseudo_op() {
     SCRATCH char *s;
-    SCRATCH unsigned count, *o, u;
+    SCRATCH unsigned count, *o, pos, u, late;
     SCRATCH SYMBOL *l;
-	FILE *binfp;
+    SCRATCH SRCFILE *sf;
 
     o = obj;
     switch (opcod -> valu) {
 	case DB:
-		do_label();
+		do_label();  fixok = onepass;
 		do {
+			pos = linepos();  unresolved = FALSE;
 			if ((lex()->attr & TYPE) == STR) {
 				for (s = token.sval; *s; *o++ = *s++) {
 					bytes++;
@@ -376,31 +665,51 @@ static void pseudo_op() {
 				if ((lex()->attr & TYPE) != SEP) unlex();
 			}
 			else {
-				unlex();
-				if ((u = expr()) > 0xff && u < 0xff80) {
+				unlex();  u = expr();
+				if (reloc) u = relocation(FIXBYTE,btell() + bytes,u);
+				else if (u > 0xff && u < 0xff80 && !unresolved) {
 					u = 0;  error('V');
 				}
+				if (unresolved) { fixup(FIXBYTE, pos, bytes);  u = 0; }
 				*o++ = low(u);  ++bytes;
 			}
 		} while ((token.attr & TYPE) == SEP);
+		fixok = FALSE;
 		break;
 
 	case DW:
-		do_label();
+		do_label();  fixok = onepass;
 		do {
-			if ((lex()->attr & TYPE) == SEP) u = 0;
+			pos = linepos();  unresolved = FALSE;
+			if ((lex()->attr & TYPE) == SEP) u = reloc = 0;
 			else { unlex();  u = expr(); }
+			if (reloc) u = relocation(FIXWORD,btell() + bytes,u);
+			if (unresolved) { fixup(FIXWORD, pos, bytes);  u = 0; }
 			*o++ = low(u);  *o++ = high(u);
 			bytes += 2;
 		} while ((token.attr & TYPE) == SEP);
+		fixok = FALSE;
 		break;
 
 	case DATE:
 		do_label();
 		/* i.e. "Mar 4 2023" */
-		time(&time_data);
-		localtime_data = localtime(&time_data);
-		strftime(date_buff, sizeof(date_buff), "%b %d %Y", localtime_data);
+		if (ctx -> epoch) {
+#ifdef _WIN32
+			gmtime_s(&localtime_data, &time_data);
+#else
+			gmtime_r(&time_data, &localtime_data);
+#endif
+		}
+		else {
+			time(&time_data);  dated = TRUE;
+#ifdef _WIN32
+			localtime_s(&localtime_data, &time_data);
+#else
+			localtime_r(&time_data, &localtime_data);
+#endif
+		}
+		strftime(date_buff, sizeof(date_buff), "%b %d %Y", &localtime_data);
 		for (s = date_buff; *s; *o++ = *s++) {
 			++bytes;
 		}
@@ -420,6 +729,7 @@ static void pseudo_op() {
 		else {
 			done = eject = TRUE;
 			if (ifsp) error('I');
+			if (block) error('N');
 		}
 		break;
 
@@ -433,17 +743,25 @@ static void pseudo_op() {
 		if (label[0]) {
 			if (pass == 1) {
 				if (!((l = new_symbol(label)) -> attr)) {
-					l -> attr = FORWD + VAL;
-					address = expr();
-					if (!forwd) l -> valu = address;
+					l -> attr = FORWD + VAL;  l -> proc = inproc;
+					pos = linepos();  fixok = onepass;  unresolved = FALSE;
+					address = expr();  fixok = FALSE;
+					if (unresolved) { l -> attr |= PEND;  fixup(FIXEQU, pos, 0) -> sym = l; }
+					else if (!forwd) { l -> valu = address;  l -> rel = reloc;  settle(l); }
+					else defer(l);
 				}
+				else if (onepass) error('M');
 			}
 			else {
 				if ((l = find_symbol(label))) {
-					l -> attr = VAL;
+					late = l -> attr & LATE;
+					if (worker) passed(l);
+					else l -> attr = VAL;
 					address = expr();
-					if (forwd) error('P');
-					if (l -> valu != address) error('M');
+					/* an EQU before it in pass 2 may have cleared LATE */
+					if (worker && forwd && late) handback();
+					if (forwd && !late) error('P');
+					if (l -> valu != address || l -> rel != reloc) error('M');
 				}
 				else error('P');
 			}
@@ -453,21 +771,60 @@ static void pseudo_op() {
 
 	case EXP:	/* label export */
 		do_label();
-		if (pass == 2) {
-			if ((lex()->attr & TYPE) == VAL) {
-				if ((l = find_symbol(token.sval))) {
-					eputs(l);
-				}
-				else error('V');
+		if (onepass) {
+			fixup(FIXEXP, linepos(), 0);
+			fixok = TRUE;  lex();  fixok = FALSE;
+		}
+		else {
+			/* only an object's exports keep their PROC blocks */
+			u = inproc;  inproc = relocate ? 0 : NOPROC;
+			if (pass == 1) lex();
+			else if ((lex()->attr & TYPE) == VAL) {
+				if (!(l = token.sym) || !l -> attr) { if (!l || !dropped(l)) error('V'); }
+				else if (!relocate) eputs(l);
+				else if (!rexport(l)) error('X');
 			}
+			inproc = u;
 		}
 
 		break;
 
+	case ENDPROC:
+		if (dead) hidden = TRUE;
+		else do_label();
+		if (!block) error('N');
+		block = dead = FALSE;  inproc = 0;
+		break;
+
+	case EXTRN:	/* symbol import */
+		do_label();
+		if (!relocate) { error('O');  break; }
+		fixok = TRUE;
+		do {
+			if ((lex() -> attr & TYPE) != VAL || token.sval[0] == '.') {
+				error('S');  break;
+			}
+			l = token.sym ? token.sym : new_symbol(token.sval);
+			u = rextern(l -> sname);
+			if (pass == 1) {
+				if (!l -> attr) {
+					l -> attr = FORWD + VAL;  l -> valu = 0;  l -> rel = u;
+					l -> proc = inproc;
+					settle(l);
+				}
+				else if (onepass) error('M');
+			}
+			else if (l -> rel != u) error('M');
+			else l -> attr = VAL;
+		} while ((lex() -> attr & TYPE) == SEP);
+		fixok = FALSE;
+		break;
+
 	case IF:   
 		if (++ifsp == IFDEPTH) fatal_error(IFOFLOW);
 		address = expr();
 		if (forwd) { error('P');  address = TRUE; }
+		else if (reloc) { error('X');  address = TRUE; }
 		if (off) { listhex = FALSE;  ifstack[ifsp] = 0; }
 		else {
 			ifstack[ifsp] = address ? ON : OFF;
@@ -478,21 +835,18 @@ static void pseudo_op() {
 	case INCB:	/* include binary */
 		do_label();
 		if ((lex()->attr & TYPE) == STR) {
+			s = token.sval;
 			if (*basedir) {
 				sprintf(filename_buff, "%s/%s", basedir, token.sval);
-				binfp = fopen(filename_buff, "rb");
+				s = filename_buff;
 			}
-			else {
-				binfp = fopen(token.sval, "rb");
-			}
-			if (!binfp) {
+			if (!(sf = sopen(s, TRUE))) {
 				error('V');
 			}
 			else {
-				while ((*o++ = fgetc(binfp)) != EOF) {
-					bytes++;
+				for (s = sf -> text; s < sf -> text + sf -> len; bytes++) {
+					*o++ = *s++ & 0377;
 				}
-				fclose(binfp);
 			}
 		}
 		else error('S');
@@ -502,51 +856,62 @@ static void pseudo_op() {
 	case INCL:	/* include source file */
 		listhex = FALSE;  do_label();
 		if ((lex() -> attr & TYPE) == STR) {
-			if (++filesp == FILES) fatal_error(FLOFLOW);
+			s = token.sval;
 			if (*basedir) {
 				sprintf(filename_buff, "%s/%s", basedir, token.sval);
-				filestk[filesp].fp = fopen(filename_buff, "r");
+				s = filename_buff;
 			}
-			else {
-				filestk[filesp].fp = fopen(token.sval, "r");
-			}
-			if (!filestk[filesp].fp) {
+			if (sload(s)) break;
+			if (++filesp == FILES) fatal_error(FLOFLOW);
+			if (!(filestk[filesp].sf = sopen(s, FALSE))) {
 				--filesp; error('V');
 			}
 			else {
 				strcpy(filestk[filesp].filename, token.sval);
 				filestk[filesp].linenum = 0;
+				filestk[filesp].ptr = filestk[filesp].sf -> text;
+				filestk[filesp].eof = FALSE;
 			}
 		}
 		else error('S');
 		break;
 
+	case KEEP:	/* PROC block roots */
+		do_label();
+		u = inproc;  inproc = 0;  fixok = pass == 1;
+		do {
+			if ((lex() -> attr & TYPE) != VAL) { error('S');  break; }
+		} while ((lex() -> attr & TYPE) == SEP);
+		inproc = u;  fixok = FALSE;
+		break;
+
 	case MSG:
 		do_label();
-		if (pass == 2) {
+		if (lastpass) {
 			do {
 				if ((lex()->attr & TYPE) == STR) {
-					fputs(token.sval, stdout);
+					say(FALSE, "%s", token.sval);
 					if ((lex()->attr & TYPE) != SEP) unlex();
 				}
 				else {
 					unlex();
 					u = expr();
-					printf("%d", u);
+					say(FALSE, "%d", u);
 				}
 			} while ((token.attr & TYPE) == SEP);
-			putchar('\n');
+			say(FALSE, "\n");
 		}
 		break;
 
 	case ALIGN:
 		u = expr();
 		if (forwd) error('P');
+		else if (reloc || (sect && !ralign(u))) error('X');
 		else {
 			/* calculate amount to pad the file */
 			if (pc % u) u -= pc % u;
 			else u = 0;
-			if (pass == 2) bpad(u);
+			if (lastpass) bpad(u);
 			pc += u;
 			address = pc;
 		}
@@ -556,6 +921,7 @@ static void pseudo_op() {
 	case BASE:
 		u = expr();
 		if (forwd) error('P');
+		else if (reloc || sect) error('X');
 		else pc = address = u;
 		do_label();
 		break;
@@ -563,10 +929,16 @@ static void pseudo_op() {
 	case ORG:   
 		u = expr();
 		if (forwd) error('P');
+		else if (reloc) error('X');
+		else if (sect) {
+			/* fix the section's address if nothing's in it yet */
+			if (pc) error('X');
+			else { rorg(u);  sect = 0;  pc = address = u; }
+		}
 		else {
 			count = u - pc;
 			/* only pad if we're not at the initial offset */
-			if ((pass == 2) && (pc != 0)) bpad(count);
+			if (lastpass && (pc != 0)) bpad(count);
 			pc = address = u;
 		}
 		do_label();
@@ -583,24 +955,51 @@ static void pseudo_op() {
 		eject = TRUE;
 		break;
 
+	case PROC:
+		if ((s = strchr(label,':')) && !s[1]) *s = '\0';
+		if (!label[0] || label[0] == '.') { error('L');  break; }
+		if (block) { error('N');  break; }
+		if (!(l = new_symbol(label)) -> proc) l -> proc = pnew();
+		block = TRUE;  inproc = l -> proc;
+		if (!live(inproc)) { dead = hidden = TRUE;  listhex = FALSE; }
+		else do_label();
+		break;
+
 	case RMB:   
 		do_label();
 		u = expr();
 		if (forwd) error('P');
+		else if (reloc) error('X');
 		else {
 			pc = u;
-			if (pass == 2) bpad(u);
+			if (lastpass) bpad(u);
 		}
 		break;
 
+	case SECT:
+		if (!relocate) error('O');
+		else if ((lex() -> attr & TYPE) != STR || !*token.sval) error('S');
+		else {
+			sect = rswitch(section = rsect(token.sval),&pc);  address = pc;
+			if ((lex() -> attr & TYPE) == SEP) {
+				u = expr();
+				if (forwd) error('P');
+				else if (reloc || !ralign(u)) error('X');
+			}
+			else unlex();
+		}
+		do_label();
+		break;
+
 	case SET:   
 		if (label[0]) {
 			if (pass == 1) {
 				if (!((l = new_symbol(label)) -> attr) || (l -> attr & SOFT)) {
-					l -> attr = FORWD + SOFT + VAL;
+					l -> attr = FORWD + SOFT + VAL;  l -> proc = inproc;
 					address = expr();
-					if (!forwd) l -> valu = address;
+					if (!forwd) { l -> valu = address;  l -> rel = reloc;  settle(l); }
 				}
+				else if (onepass) error('M');
 			}
 			else {
 				if ((l = find_symbol(label))) {
@@ -608,7 +1007,7 @@ static void pseudo_op() {
 					if (forwd) error('P');
 					else if (l -> attr & SOFT) {
 						l -> attr = SOFT + VAL;
-						l -> valu = address;
+						l -> valu = address;  l -> rel = reloc;
 					}
 					else error('M');
 				}
@@ -627,3 +1026,170 @@ static void pseudo_op() {
     }
     return;
 }
+
+/*  Single-pass fixup routines.  A field with forward references gets	*/
+/*  a zero placeholder in the object and a fixup recording where the	*/
+/*  field starts in the source line and where its byte(s) went in the	*/
+/*  binary file.  At the end of the line, the line is saved for all of	*/
+/*  its fixups to share.  Once every symbol is known, resolve() reads	*/
+/*  the saved fields again and patches the binary file and listing.	*/
+
+static FIXUP *fixup(unsigned kind, unsigned pos, unsigned index) {
+    SCRATCH FIXUP *f;
+
+    f = (FIXUP *)arena(sizeof(FIXUP));
+    f -> kind = kind;  f -> pos = pos;  f -> offset = btell() + index;
+    f -> sym = NULL;
+    *fixtail = f;  fixtail = &(f -> next);
+    if (!fixline) fixline = f;
+    return f;
+}
+
+static void save_fixups() {
+    SCRATCH FIXLINE *fl;
+    SCRATCH FIXUP *f;
+    SCRATCH size_t n;
+
+    if (fixline) {
+		n = strlen(line) + 1;
+		fl = (FIXLINE *)arena(sizeof(FIXLINE) + n);
+		fl -> pc = pc;  fl -> section = section;
+		fl -> linenum = filestk[filesp].linenum;
+		fl -> errcode = errcode;  fl -> lrec = ltell();
+		strcpy(fl -> text,line);
+		fl -> glob = lastglobal;
+		fl -> file = intern(filestk[filesp].filename);
+		for (f = fixline; f; f = f -> next) f -> fl = fl;
+		fixline = NULL;
+    }
+    return;
+}
+
+static void resolve() {
+    SCRATCH FIXUP *f;
+    SCRATCH FIXLINE *fl;
+    SCRATCH SYMBOL *l;
+    SCRATCH unsigned u;
+    SCRATCH int more;
+
+    filesp = 0;
+    /* the EQUs first, each as soon as the labels it waits on are known */
+    do {
+		for (more = FALSE, f = fixups; f; f = f -> next)
+			if ((f -> kind & FIXKIND) == FIXEQU && f -> sym -> attr & PEND) {
+				refix(f);
+				fixok = TRUE;  unresolved = FALSE;
+				u = expr();  fixok = FALSE;
+				if (!unresolved) {
+					f -> sym -> valu = u;  f -> sym -> rel = reloc;
+					f -> sym -> attr &= ~PEND;
+					laddr(f -> fl -> lrec,u);  more = TRUE;
+				}
+				f -> fl -> errcode = errcode;
+				lflag(f -> fl -> lrec,errcode);
+			}
+    } while (more);
+
+    for (f = fixups; f; f = f -> next) {
+		fl = f -> fl;
+		refix(f);
+		if ((f -> kind & FIXKIND) == FIXEQU) {
+			/* what's still waiting is undefined, or waits on itself */
+			if (f -> sym -> attr & PEND) {
+				u = expr();
+				f -> sym -> valu = u;  f -> sym -> rel = reloc;
+				f -> sym -> attr &= ~PEND;
+				laddr(fl -> lrec,u);
+			}
+		}
+		else if ((f -> kind & FIXKIND) == FIXEXP) {
+			if ((lex()->attr & TYPE) == VAL) {
+				if (!(l = token.sym) || !l -> attr) error('V');
+				else if (!relocate) eputs(l);
+				else if (!rexport(l)) error('X');
+			}
+		}
+		else {
+			/* DB and DW read the first token ahead, as lex() did here */
+			if (!(f -> kind & FIXARG)) { lex();  unlex(); }
+			u = f -> kind & FIXARG ? do_args() : expr();
+			if ((f -> kind & FIXKIND) == FIXREL ? reloc != sect : reloc) {
+				u = relocation(f -> kind & FIXKIND,f -> offset,u);
+				bpatch(f -> offset,low(u));
+				if ((f -> kind & FIXKIND) == FIXWORD) bpatch(f -> offset + 1,high(u));
+			}
+			else switch (f -> kind & FIXKIND) {
+			case FIXBYTE:
+				if (u > 0xff && u < 0xff80) { error('V');  u = 0; }
+				bpatch(f -> offset,low(u));
+				break;
+
+			case FIXZP:
+				if (u > 0x00ff) { error('V');  u = 0; }
+				bpatch(f -> offset,low(u));
+				break;
+
+			case FIXWORD:
+				bpatch(f -> offset,low(u));
+				bpatch(f -> offset + 1,high(u));
+				break;
+
+			case FIXREL:
+				u -= pc + 2;
+				if (clamp(u) > 0x007f && u < 0xff80) {
+					error('B');  u = 0xfffe;
+				}
+				bpatch(f -> offset,low(u));
+				break;
+			}
+		}
+		fl -> errcode = errcode;
+		lflag(fl -> lrec,errcode);
+    }
+    rescan(NULL);
+    return;
+}
+
+/*  Sets up to read the field of fixup f again.				*/
+
+static void refix(FIXUP *f) {
+    SCRATCH FIXLINE *fl;
+
+    fl = f -> fl;
+    if (relocate) sect = rswitch(fl -> section,&pc);
+    errcode = fl -> errcode;  pc = fl -> pc;
+    lastglobal = fl -> glob;
+    strcpy(filestk[0].filename,fl -> file);
+    filestk[0].linenum = fl -> linenum;
+    forwd = forceabs = FALSE;
+    rescan(fl -> text + f -> pos);
+    return;
+}
+
+/*  Relocation routine.  In relocatable mode, a field of fixup kind	*/
+/*  kind at offset in the section whose value u is relative to the	*/
+/*  base reloc gets a relocation record for the linker.  A byte has to	*/
+/*  hold the LOW or HIGH of such a value, and a word the whole of it.	*/
+/*  Returns what the field holds until it's linked.			*/
+
+static unsigned relocation(unsigned kind, unsigned long offset, unsigned u) {
+    SCRATCH unsigned type;
+
+    switch (kind) {
+	case FIXBYTE:	type = reloc & RELLOW ? RLOW : RHIGH;
+					if (!(reloc & RELPART)) { error('X');  return 0; }
+					break;
+
+	case FIXWORD:	type = RWORD;
+					if (reloc & RELPART) { error('X');  return 0; }
+					break;
+
+	case FIXREL:	type = RREL;
+					if (reloc & RELPART) { error('X');  return 0; }
+					break;
+
+	default:		error('X');  return 0;
+    }
+    if (lastpass) rput(type,offset,reloc,u);
+    return type == RWORD ? u : type == RLOW ? low(u) : type == RHIGH ? high(u) : 0;
+}
@@ -26,7 +26,16 @@ all modules of the cross-assembler.
 /*  varible is made static below, but you might want to try register	*/
 /*  instead.								*/
 
-#define	SCRATCH		static
+/*  The assembler's state, SCRATCH variables included, is kept per	*/
+/*  thread, so that each thread can run an assembly of its own.	*/
+
+#ifdef _MSC_VER
+#define	THREAD		__declspec(thread)
+#else
+#define	THREAD		_Thread_local
+#endif
+
+#define	SCRATCH		static THREAD
 
 /*  A slow, but portable way of cracking an unsigned into its various	*/
 /*  component parts:							*/
@@ -48,26 +57,44 @@ all modules of the cross-assembler.
 
 #define	ASMOPEN		"Source File Did Not Open"
 #define	ASMREAD		"Error Reading Source File"
+#define	BADDATE		"Illegal Date Given"
+#define	DEPOPEN		"Dependency File Did Not Open"
 #define EXPOPEN		"Export File Did Not Open"
 #define	DSKFULL		"Disk or Directory Full"
 #define	FLOFLOW		"File Stack Overflow"
 #define	HEXOPEN		"Object File Did Not Open"
 #define	IFOFLOW		"If Stack Overflow"
 #define	LSTOPEN		"Listing File Did Not Open"
+#define	MANOPEN		"Manifest File Did Not Open"
+#define	MEMFULL		"Out of Memory"
 #define	NOASM		"No Source File Specified"
 #define NOEXP		"No Export File Specified"
+#define	NOSOCK		"Daemon Socket Did Not Open"
+#define	NOTEQU		"Source Is Not All Equates"
+#define	NOWATCH		"Files Could Not Be Watched"
+#define	SNPOPEN		"Snapshot File Did Not Open"
 #define	SYMBOLS		"Too Many Symbols"
+#define	TWODMN		"Daemon Already Running"
 
 /*  The warning messages generated by the assembler:			*/
 
 #define	BADOPT		"Illegal Option Ignored"
+#define	BADSNAP		"Bad Symbol Snapshot Ignored"
+#define	NOCACHE		"-c Option Ignored -- No File Name"
+#define	NODEP		"-f Option Ignored -- No File Name"
 #define	NODIR		"-b Option Ignored -- No File Name"
 #define	NOHEX		"-o Option Ignored -- No File Name"
+#define	NOJOBS		"-j Option Ignored -- No Count"
 #define	NOLST		"-l Option Ignored -- No File Name"
+#define	NOMAN		"-m Option Ignored -- No File Name"
+#define	NOTIME		"-t Option Ignored -- No Time"
+#define	OLDSNAP		"Out of Date Symbol Snapshot Ignored"
 #define	TWOASM		"Extra Source File Ignored"
+#define	TWODEP		"Extra Dependency File Ignored"
 #define TWOEXP		"Extra Export File Ignored"
 #define	TWOHEX		"Extra Object File Ignored"
 #define	TWOLST		"Extra Listing File Ignored"
+#define	TWOMAN		"Extra Manifest File Ignored"
 
 /*  Line assembler (A65.C) constants:					*/
 
@@ -93,36 +120,185 @@ typedef enum {
 	ELSE,
 	END,
 	ENDI,
+	ENDPROC,
 	EQU,
 	EXP,
+	EXTRN,
 	IF,
 	INCB,
 	INCL,
+	KEEP,
 	MSG,
 	ORG,
 	PAGE,
+	PROC,
 	RMB,
+	SECT,
 	SET,
 	TITL
 } PSEUDO_OP;
 
-/*  Line assembler (A65.C) machine opcode attribute values:		*/
+/*  Line assembler (A65.C) machine opcode addressing modes:		*/
+
+#define	AM_IMP		0	/*  implied				*/
+#define	AM_ACC		1	/*  accumulator				*/
+#define	AM_IMM		2	/*  immediate				*/
+#define	AM_ZP		3	/*  zero page				*/
+#define	AM_ZPX		4	/*  zero page,X				*/
+#define	AM_ZPY		5	/*  zero page,Y				*/
+#define	AM_ABS		6	/*  absolute				*/
+#define	AM_ABX		7	/*  absolute,X				*/
+#define	AM_ABY		8	/*  absolute,Y				*/
+#define	AM_IND		9	/*  (indirect)				*/
+#define	AM_INX		10	/*  (indirect,X)			*/
+#define	AM_INY		11	/*  (indirect),Y			*/
+#define	AM_REL		12	/*  relative				*/
+#define	MODES		13
+#define	AM_BAD		MODES	/*  no such addressing mode		*/
+
+/*  Line assembler (A65.C) single-pass fixup kinds.  FIXARG marks a	*/
+/*  machine opcode argument field that is re-read with do_args().	*/
+
+#define	FIXBYTE		0	/*  byte, -128 thru 255			*/
+#define	FIXZP		1	/*  zero page address			*/
+#define	FIXWORD		2	/*  16-bit word, low byte first		*/
+#define	FIXREL		3	/*  relative branch displacement	*/
+#define	FIXEXP		4	/*  EXP symbol name			*/
+#define	FIXEQU		5	/*  EQU expression			*/
+#define	FIXKIND		0x0f
+#define	FIXARG		0x10
+
+/*  Line assembler (A65.C) single-pass fixup list.  Every source line	*/
+/*  with forward references is saved once, along with the state needed	*/
+/*  to re-read it, and each forward-referenced field points back to it	*/
+/*  with the offset of its object byte(s) in the binary file, or, for	*/
+/*  an EQU, the label waiting on its expression.  The global label and	*/
+/*  file names are interned strings.					*/
+
+typedef struct {
+    unsigned pc, section;
+    int linenum;
+    char errcode;
+    unsigned long lrec;
+    char *glob, *file;
+    char text[1];
+} FIXLINE;
+
+typedef struct _fixup {
+    struct _fixup *next;
+    FIXLINE *fl;
+    unsigned kind, pos;
+    unsigned long offset;
+    struct _symbol *sym;
+} FIXUP;
+
+/*  Utility package (A65UTIL.C) file hash (SHA-256) state.	*/
+
+#define	HASHSIZE	32		/*  bytes in a hash		*/
+
+typedef struct {
+    unsigned long h[8];
+    unsigned long long n;
+    unsigned char buf[64];
+} HASH;
+
+/*  Utility package (A65UTIL.C) source file cache entry.  The file	*/
+/*  contents are read once and shared by every pass and every INCL or	*/
+/*  INCB of the same file.  The cache outlives the assembly, so a file	*/
+/*  is read again in a later one only if its size or time has changed.	*/
+/*  An entry is found by its full path as well as by the name it was	*/
+/*  asked for, so the same name in another directory is another file.	*/
+/*  users counts the assemblies using the entry, and stale is set once	*/
+/*  a newer copy has replaced it.  A file handed over in memory (mem is	*/
+/*  set) is never read.  The hash of the contents is worked out the	*/
+/*  first time it's wanted (hashed is set once it has been).		*/
+
+typedef struct _srcfile {
+    struct _srcfile *next;
+    char *text;
+    size_t len;
+    long long size, mtime;
+    unsigned users;
+    int binary, mem, stale, hashed;
+    unsigned char hash[HASHSIZE];
+    char *path;
+    char sname[1];
+} SRCFILE;
 
-#define	CPXY		0
-#define	BITOP		1
-#define	INHOP		2
-#define	JUMP		3
-#define	CALL		4
-#define	LOGOP		5
-#define	RELBR		6
-#define	STXY		7
-#define	TWOOP		8
-#define	LDXY		9
-#define	INCOP		10
+/*  Utility package (A65UTIL.C) include file reader.  While pass 1	*/
+/*  runs, a thread goes through the source ahead of the assembler and	*/
+/*  reads the files named by its INCL and INCB statements into the	*/
+/*  cache, following INCL files into the files they include.  stop is	*/
+/*  set (under the cache's lock) when the assembly is done with it.	*/
+
+typedef struct {
+    SRCFILE *sf;
+    int stop;
+    char basedir[MAXLINE];
+} READER;
+
+/*  Utility package (A65UTIL.C) symbol snapshot layout:			*/
+
+#define	SNAPEXT		".a65s"		/*  added to the header's name	*/
+#define	SNAPMAGIC	"A65NSNP2"	/*  first 8 bytes		*/
+#define	SNAPHEAD	(8 + HASHSIZE + 4)	/*  bytes before the files	*/
+#define	SNAPSOFT	0x01		/*  symbol was defined by SET	*/
+
+/*  Utility package (A65UTIL.C) relocatable object.  With -r, the	*/
+/*  object file holds sections instead of a binary image.  Each	*/
+/*  section, and each symbol imported with EXTRN, is a base, and a	*/
+/*  value relative to one carries the base's number in its upper bits	*/
+/*  through the expression evaluator.  LOW and HIGH of such a value	*/
+/*  leave it alone but for RELLOW or RELHIGH.  A field that ends up	*/
+/*  holding one gets a relocation record for the linker.  A section	*/
+/*  that is ORG'ed before anything goes in it has a fixed address, and	*/
+/*  its labels are absolute.						*/
+
+#define	RELBASE		0x3fff0000	/*  base number, shifted left 16	*/
+#define	RELLOW		0x40000000	/*  LOW of the value		*/
+#define	RELHIGH		0x80000000	/*  HIGH of the value		*/
+#define	RELPART		(RELLOW | RELHIGH)
+#define	RELBITS		(RELBASE | RELPART)
+#define	RELMAX		0x3fff		/*  most bases in an object	*/
+#define	reltag(n)	((unsigned)(n) << 16)
+#define	relnum(u)	(((u) & RELBASE) >> 16)
+
+#define	DEFSECT		"CODE"		/*  section before the first SECT	*/
+
+typedef struct {
+    char *name;
+    unsigned kind, org, pc;
+    unsigned char *image, *rel;
+    unsigned long align, size, imgsize, nrel, relsize;
+} RBASE;
+
+/*  Relocatable object file layout, shared with the linker (A65LINK.C).	*/
+/*  Numbers are little-endian and names end with a \0.  OBJMAGIC is	*/
+/*  followed by a 2-byte count of bases.  Each base is its kind and	*/
+/*  name, and a section then has a 2-byte address (if fixed), a	*/
+/*  4-byte alignment (its address must be a multiple of it), 4-byte	*/
+/*  counts of its bytes and relocations, its bytes, and its		*/
+/*  relocations.  A relocation is the 2-byte offset of its field, its	*/
+/*  type, a 2-byte base number, and the 2-byte value added to the	*/
+/*  base.  Last comes a 2-byte count of exports, each a name, a 2-byte	*/
+/*  base number, and a 2-byte value.  Base numbers count from 1, and 0	*/
+/*  means the value is absolute.					*/
+
+#define	OBJMAGIC	"A65NOBJ2"	/*  first 8 bytes		*/
+#define	OBJSECT		0		/*  relocatable section		*/
+#define	OBJFIXED	1		/*  section at a fixed address	*/
+#define	OBJEXTRN	2		/*  imported symbol		*/
+#define	RWORD		0		/*  16-bit field, low byte first	*/
+#define	RLOW		1		/*  low byte of the value	*/
+#define	RHIGH		2		/*  high byte of the value	*/
+#define	RREL		3		/*  branch displacement		*/
+#define	RELSIZE		7		/*  bytes in a relocation	*/
 
 /* Line assembler (a65.c) file struct */
 typedef struct {
-	FILE *fp;
+	SRCFILE *sf;
+	char *ptr;
+	int eof;
 	char filename[MAXLINE];
 	int linenum;
 } FILE_INFO;
@@ -141,9 +317,18 @@ typedef struct {
 typedef struct {
     unsigned attr;
     unsigned valu;
-    char sval[MAXLINE + 1];
+    char *sval;
+    struct _symbol *sym;
+    char sbuf[MAXLINE + 1];
 } TOKEN;
 
+/*  Lexical analyzer (A65EVAL.C) character class bits:			*/
+
+#define	CC_ALPH		001	/*  can start a name			*/
+#define	CC_NUM		002	/*  decimal digit			*/
+#define	CC_HEX		004	/*  hexadecimal digit			*/
+#define	CC_BLANK	010	/*  blank or tab			*/
+
 /*  Lexical analyzer (A65EVAL.C) token attribute values:		*/
 
 typedef enum {
@@ -165,6 +350,9 @@ typedef enum {
 
 #define	FORWD		0x8000	/*  Value:	is forward referenced	*/
 #define	SOFT		0x4000	/*		is redefinable		*/
+#define	PEND		0x2000	/*		waits on other symbols	*/
+#define	LATE		0x1000	/*		was settled after its EQU	*/
+#define	AHEAD		0x0800	/*		wasn't defined yet in pass 1	*/
 
 #define	TYPE		0x000f	/*  All:	token type		*/
 
@@ -202,27 +390,282 @@ typedef enum {
 #define	ENDEX		0x0b00	/*  end of expression			*/
 #define	START		0x0c00	/*  beginning of expression		*/
 
-/*  Utility package (A65UTIL.C) symbol table routines:			*/
+/*  Utility package (A65UTIL.C) symbol table routines.  The symbol	*/
+/*  table is an open-addressed hash table of slots holding each name's	*/
+/*  hash, the one stored copy of the name, the symbol (if any) of that	*/
+/*  name, and for a global label the scope table of its local labels.	*/
+/*  Names and symbols are drawn from a memory arena and never move, so	*/
+/*  other tables can point at them, and two interned names are the	*/
+/*  same name only if they are the same pointer.			*/
 
 struct _symbol {
     unsigned attr;
     unsigned valu;
-    struct _symbol *left, *right;
-    char sname[1];
+    unsigned rel;		/*  base of a relocatable value	*/
+    unsigned proc;		/*  PROC block it's defined in	*/
+    char *sname;
+    struct _waitrec *wait;
 };
 
 typedef struct _symbol SYMBOL;
 
+/*  Utility package (A65UTIL.C) dead code elimination.  PROC blocks	*/
+/*  are numbered from 1 as pass 1 meets them, and 0 stands for code	*/
+/*  outside any block.  Each reference pass 1 finds to a label is	*/
+/*  recorded with the block it's made from.				*/
+
+typedef struct {
+    unsigned from;
+    SYMBOL *to;
+} PROCREF;
+
+#define	NOPROC		(~0u)	/*  made from nowhere:  doesn't count	*/
+
+typedef struct _scope SCOPE;
+
+typedef struct {
+    unsigned hash;
+    char *name;
+    SYMBOL *sym;
+    SCOPE *scope;
+} SYMSLOT;
+
+struct _scope {
+    unsigned size, count;
+    SYMSLOT *slot;
+};
+
 #define	SYMCOLS		4
+#define	SYMSIZE		1024	/*  initial hash table size		*/
+#define	SCOPESIZE	8	/*  initial local label table size	*/
+#define	ARENASIZE	65536	/*  memory arena block size		*/
 
 /*  Utility package (A65UTIL.C) opcode/operator table routines:		*/
 
 typedef struct {
     unsigned attr;
     unsigned valu;
-    char oname[6];
+    char oname[8];
 } OPCODE;
 
+/*  The machine opcodes are kept in an encoding table giving the opcode	*/
+/*  byte and the cycle count for each addressing mode.  A cycle count	*/
+/*  of 0 means the instruction doesn't have that addressing mode.	*/
+
+typedef struct {
+    OPCODE code;
+    unsigned char op[MODES], cyc[MODES];
+} ENCODING;
+
+/*  The tables are looked up through one perfect hash of the name,	*/
+/*  upper-cased and packed into an integer.  Each keyword appears once	*/
+/*  and points at its opcode and/or operator table entry.		*/
+
+typedef struct {
+    unsigned long long key;
+    OPCODE *code, *oper;
+} KEYWORD;
+
+#define	KEYBITS		10	/*  log2 of keyword hash table size	*/
+#define	KEYLEN		7	/*  longest keyword			*/
+
+/*  Lexical analyzer (A65EVAL.C) token cache.  Pass 1 of a two-pass	*/
+/*  assembly records each source line's label and opcode fields and the	*/
+/*  tokens of its argument field, and pass 2 replays them instead of	*/
+/*  reading the source again.  Labels used in the argument field are	*/
+/*  kept as symbol table pointers so pass 2 picks up their final	*/
+/*  values.  A label that was still waiting on its EQU when pass 1 used	*/
+/*  it has FORWD set in its token's attribute word, so pass 2 makes the	*/
+/*  same decisions with it, and one that wasn't defined yet has AHEAD	*/
+/*  set, for the pass 2 workers.  Lines skipped by pass 1 have no	*/
+/*  tokens (untok is set), and pass 2 only reads them again if it needs	*/
+/*  to.									*/
+
+typedef struct {
+    unsigned attr, valu;
+    char err;
+    union {
+		SYMBOL *sym;
+		char *str;
+    } p;
+} TOKREC;
+
+typedef struct {
+    char *text, *file, *label;
+    OPCODE *opcod;
+    unsigned len, argpos;
+    unsigned long tok, ntok, exp, nexp;
+    int linenum, filesp;
+    char ferr, hasop, untok;
+} LINEREC;
+
+/*  Expression evaluator (A65EVAL.C) compiled expressions.  While pass	*/
+/*  1 of a two-pass assembly records the token cache, each expression	*/
+/*  it evaluates is also compiled into postfix code, with constant	*/
+/*  parts folded as it goes.  Pass 2 runs the code instead of parsing	*/
+/*  the expression's tokens again, then picks up at the token that	*/
+/*  ended it.  Expressions with syntax errors aren't compiled.		*/
+
+#define	XCONST		0	/*  push valu				*/
+#define	XSYM		1	/*  push the value of sym (valu holds	*/
+				/*  XWAIT and/or XAHEAD)		*/
+#define	XPC		2	/*  push the location counter		*/
+#define	XUNARY		3	/*  apply unary operator valu		*/
+#define	XBINARY		4	/*  apply binary operator valu		*/
+
+#define	XWAIT		1	/*  sym was waiting on its EQU		*/
+#define	XAHEAD		2	/*  sym wasn't defined yet		*/
+
+typedef struct {
+    unsigned op, valu;
+    SYMBOL *sym;
+} XCODE;
+
+typedef struct {
+    unsigned long tok, term, code;
+    unsigned ncode;
+    int pushed;
+} EXPREC;
+
+/*  The token cache and compiled expressions of an assembly, lent to	*/
+/*  its pass 2 workers.							*/
+
+typedef struct {
+    LINEREC *lines;
+    TOKREC *toks;
+    EXPREC *exps;
+    XCODE *xcode;
+    unsigned long nlines;
+} LEXCACHE;
+
+/*  Line assembler (A65.C) pass 2 workers.  While pass 1 of a big	*/
+/*  enough source runs, the state the line assembler carries from line	*/
+/*  to line is saved every PARLINES lines.  Pass 2 starts with a pool	*/
+/*  of threads assembling the runs of lines between the saved states at	*/
+/*  once, each run into its own listing rows, object bytes, and error	*/
+/*  lines.  Workers only read the symbol table, so a run also keeps the	*/
+/*  labels whose definitions it passed.  A worker stops a run at the	*/
+/*  first line it can't assemble by itself (see alone() in A65.C), and	*/
+/*  stop and end are where it got to.  The main thread then goes	*/
+/*  through pass 2, and at the start of each run whose saved state it	*/
+/*  has reached, takes the run's output up to stop in order instead of	*/
+/*  assembling those lines.						*/
+
+#define	PARLINES	4096	/*  lines between saved states		*/
+
+typedef struct {
+    unsigned pc, inproc;
+    int off, ifsp, block, dead;
+    char *lastglobal;
+    int ifstack[IFDEPTH];
+} PSTATE;
+
+typedef struct {
+    PSTATE start, end;
+    unsigned long first, last, stop;
+    char *rows, *diag;
+    size_t nrows, diaglen;
+    unsigned char *code;
+    unsigned long ncode;
+    SYMBOL **defs;
+    unsigned long ndefs;
+    unsigned errors;
+} RUNREC;
+
+/*  The symbol table and PROC blocks of an assembly, lent to its pass	*/
+/*  2 workers.								*/
+
+typedef struct {
+    SCOPE globals;
+    char *plive;
+    unsigned nprocs;
+} SYMTAB;
+
+typedef struct {
+    RUNREC *runs;
+    unsigned long nruns;
+    unsigned step;
+    LEXCACHE *lex;
+    SYMTAB *syms;
+    int listing;
+} WORKER;
+
+/*  Expression evaluator (A65EVAL.C) equate resolver.  An EQU whose	*/
+/*  expression is forward-referenced in pass 1 is deferred:  it gets a	*/
+/*  DEFREC holding its compiled expression and the count of symbols it	*/
+/*  still waits on, and each of those symbols gets a WAITREC pointing	*/
+/*  back at it.  As the symbols get their values, the count drops, and	*/
+/*  at zero the expression is run and the EQU settled in turn.  EQUs	*/
+/*  left waiting at the end of pass 1 are on a cycle.			*/
+
+typedef struct {
+    SYMBOL *sym;
+    unsigned long exp;
+    unsigned npend, pc, sect;
+} DEFREC;
+
+typedef struct _waitrec {
+    struct _waitrec *next;
+    DEFREC *def;
+} WAITREC;
+
+/*  Utility package (A65UTIL.C) held listing line.  In single-pass	*/
+/*  mode the listing is kept in memory until the fixups are done.	*/
+
+typedef struct {
+    char errcode, listhex, eject;
+    unsigned address, bytes, pagelen;
+    unsigned long offset;
+    char *title, *text;
+} LISTREC;
+
+/*  Utility package (A65UTIL.C) listing writer.  Each row of the	*/
+/*  listing goes into a fixed-width record, and a writer thread of the	*/
+/*  listing's own formats the records into a buffer of LBUFSIZE bytes	*/
+/*  and writes it out as it fills, so pass 2 doesn't wait on the	*/
+/*  listing file.  The records go to the writer through a ring of	*/
+/*  LRING of them:  the assembly is the only one to move head, and the	*/
+/*  writer the only one to move tail, so neither takes a lock unless	*/
+/*  the ring is full (full set) or empty (idle set) and it has to sleep	*/
+/*  on wake.  ff is set in a row that ends a page, with the title (if	*/
+/*  any) to put at the top of the next one.  Without threads, or once	*/
+/*  the writer has stopped, records are formatted as they're made.	*/
+
+#define	LRING		4096
+#define	LBUFSIZE	65536
+#define	LROWMAX		(2 * MAXLINE + 80)	/*  longest formatted row	*/
+
+typedef struct {
+    char errcode, listhex, nbytes, ff;
+    unsigned address, len;
+    unsigned obj[4];
+    char *title;
+    char text[MAXLINE + 2];
+} LISTROW;
+
+#if !defined(__STDC_NO_THREADS__) && !defined(__STDC_NO_ATOMICS__)
+#define	LWRITER_THREAD
+#include <stdatomic.h>
+#include <threads.h>
+#endif
+
+typedef struct {
+    FILE *fp;
+    int failed;
+    size_t nbuf;
+    LISTROW one;
+    char buf[LBUFSIZE];
+#ifdef LWRITER_THREAD
+    int running;
+    LISTROW *ring;
+    atomic_ulong head, tail;
+    atomic_int idle, full, done, lost;
+    mtx_t lock;
+    cnd_t wake;
+    thrd_t thread;
+#endif
+} LWRITER;
+
 /*  Utility package (A65UTIL.C) hex file output routines:		*/
 
 #define	HEXSIZE		8192
@@ -0,0 +1,274 @@
+/*
+		      6502 Cross-Assembler in Portable C
+
+		   Copyright (c) 1986 William C. Colley, III
+
+This file contains the batch mode driver of the a65n command.  It reads a
+manifest of jobs, assembles them on a pool of threads, and prints what each
+job had to say in manifest order.  Under GNU make, the pool takes a token from
+make's jobserver for every job it runs past the first, so that the build as a
+whole doesn't run more jobs than make was told to.
+*/
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#ifndef __STDC_NO_THREADS__
+#include <threads.h>
+#endif
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+/*  Get global goodies:  */
+
+#include "a65.h"
+#include "a65cmd.h"
+
+/* Static function declarations: */
+static int readjobs(A65CTX *ctx, char *manifest);
+static int nojobs(FILE *fp, char *msg);
+static void split(char *s, char **argv, int *argc);
+static unsigned processors();
+static void jobserver();
+static int take(char *tok);
+static void give(char tok);
+
+/*  The jobs of the manifest.  next is the next job to be started, and	*/
+/*  done is set in a job once it has finished.  jlock guards both, and	*/
+/*  jdone is signalled as each job finishes.				*/
+
+static JOB *jobv = NULL;
+static unsigned njobs = 0, next = 0;
+
+#ifndef __STDC_NO_THREADS__
+static mtx_t jlock;
+static cnd_t jdone;
+
+static int runjobs(void *arg);
+#endif
+
+int batch(A65CTX *ctx, char *manifest, unsigned jobs) {
+    SCRATCH unsigned i, n, fatal;
+    SCRATCH JOB *j;
+#ifndef __STDC_NO_THREADS__
+    thrd_t *tv;
+#endif
+
+    if (!readjobs(ctx,manifest)) return -1;
+    if (!njobs) return 0;
+    if (!jobs) jobs = processors();
+    if (jobs > njobs) jobs = njobs;
+    jobserver();
+
+#ifndef __STDC_NO_THREADS__
+    mtx_init(&jlock,mtx_plain);  cnd_init(&jdone);
+    if (!(tv = (thrd_t *)malloc(jobs * sizeof(thrd_t)))) {
+		printf("Fatal Error -- %s\n",MEMFULL);  return -1;
+    }
+    for (i = 0; i < jobs; ++i)
+		if (thrd_create(tv + i,runjobs,i ? NULL : (void *)tv) != thrd_success) break;
+    if (!i) runjobs(tv);
+    jobs = i;
+#endif
+
+    for (n = fatal = 0, j = jobv; j < jobv + njobs; ++j) {
+#ifndef __STDC_NO_THREADS__
+		mtx_lock(&jlock);
+		while (!j -> done) cnd_wait(&jdone,&jlock);
+		mtx_unlock(&jlock);
+#else
+		j -> result = a65n_assemble(&(j -> ctx));
+#endif
+		if (j -> ctx.diaglen) fwrite(j -> ctx.diag,1,j -> ctx.diaglen,stdout);
+		if (j -> result < 0) fatal = TRUE;
+		else n += j -> result;
+		a65n_release(&(j -> ctx));  free(j -> words);
+    }
+
+#ifndef __STDC_NO_THREADS__
+    for (i = 0; i < jobs; ++i) thrd_join(tv[i],NULL);
+    free(tv);
+    mtx_destroy(&jlock);  cnd_destroy(&jdone);
+#endif
+    free(jobv);  jobv = NULL;  njobs = next = 0;
+    a65n_forget();
+    return fatal ? -1 : n;
+}
+
+#ifndef __STDC_NO_THREADS__
+
+/*  Pool thread.  Jobs are taken in manifest order by whichever thread	*/
+/*  is free.  The first thread runs on the token make gives every	*/
+/*  command it starts; the others take one from the jobserver for each	*/
+/*  job.								*/
+
+static int runjobs(void *arg) {
+    JOB *j;
+    char tok;
+    int took;
+
+    for (;;) {
+		mtx_lock(&jlock);
+		j = next < njobs ? jobv + next++ : NULL;
+		mtx_unlock(&jlock);
+		if (!j) break;
+		took = !arg && take(&tok);
+		j -> result = a65n_assemble(&(j -> ctx));
+		if (took) give(tok);
+		mtx_lock(&jlock);
+		j -> done = TRUE;  cnd_broadcast(&jdone);
+		mtx_unlock(&jlock);
+    }
+    return 0;
+}
+
+#endif
+
+/*  Reads the manifest.  Each line that isn't blank or a comment	*/
+/*  (starting with ;) is a job, its words parsed like a command line	*/
+/*  (a word may be put in quotes) on top of the options in ctx.	*/
+/*  Returns FALSE, with the fatal error reported, if the manifest can't	*/
+/*  be read.								*/
+
+static int readjobs(A65CTX *ctx, char *manifest) {
+    SCRATCH FILE *fp;
+    SCRATCH JOB *j;
+    SCRATCH unsigned size;
+    SCRATCH char *p;
+    char *argv[MAXLINE + 1], buf[MAXLINE * 4 + 2];
+    int argc;
+
+    if (!(fp = fopen(manifest,"r"))) return nojobs(NULL,MANOPEN);
+    size = 0;
+    while (fgets(buf,sizeof(buf),fp)) {
+		for (p = buf; *p == ' ' || *p == '\t'; ++p);
+		if (!*p || *p == '\n' || *p == ';') continue;
+		if (njobs == size) {
+			size = size ? size * 2 : 64;
+			if (!(j = (JOB *)realloc(jobv,size * sizeof(JOB)))) return nojobs(fp,MEMFULL);
+			jobv = j;
+		}
+		j = jobv + njobs;
+		memset(j,0,sizeof(JOB));
+		if (!(j -> words = (char *)malloc(strlen(p) + 1))) return nojobs(fp,MEMFULL);
+		++njobs;
+		argv[0] = manifest;  argc = 1;
+		split(strcpy(j -> words,p),argv,&argc);
+		j -> ctx.basedir = ctx -> basedir;  j -> ctx.onepass = ctx -> onepass;
+		j -> ctx.cache = ctx -> cache;  j -> ctx.epoch = ctx -> epoch;
+		j -> ctx.relocate = ctx -> relocate;
+		options(argc,argv,&(j -> ctx),NULL);
+    }
+    fclose(fp);
+    return TRUE;
+}
+
+/*  Reports fatal error msg for the manifest, closing it (if fp isn't	*/
+/*  NULL) and dropping the jobs read from it.  Returns FALSE.		*/
+
+static int nojobs(FILE *fp, char *msg) {
+    printf("Fatal Error -- %s\n",msg);
+    if (fp) fclose(fp);
+    while (njobs) free(jobv[--njobs].words);
+    free(jobv);  jobv = NULL;
+    return FALSE;
+}
+
+/*  Splits string s into words in place, adding them to argv.		*/
+
+static void split(char *s, char **argv, int *argc) {
+    for (;;) {
+		while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') ++s;
+		if (!*s || *argc == MAXLINE) break;
+		argv[(*argc)++] = s;
+		if (*s == '"') {
+			argv[*argc - 1] = ++s;
+			while (*s && *s != '"' && *s != '\n') ++s;
+		}
+		else while (*s && *s != ' ' && *s != '\t' && *s != '\r' && *s != '\n') ++s;
+		if (*s) *s++ = '\0';
+    }
+    argv[*argc] = NULL;
+    return;
+}
+
+/*  Returns the number of processors, or 1 if that can't be found.	*/
+
+static unsigned processors() {
+#ifndef _WIN32
+    SCRATCH long n;
+
+    if ((n = sysconf(_SC_NPROCESSORS_ONLN)) > 0) return n;
+#endif
+    return 1;
+}
+
+/*  GNU make jobserver client.  make passes the jobserver in MAKEFLAGS,	*/
+/*  either as a pair of pipe file descriptors (--jobserver-auth=R,W or	*/
+/*  the older --jobserver-fds=R,W) or as a named pipe			*/
+/*  (--jobserver-auth=fifo:PATH).  A token is a byte read from the	*/
+/*  pipe, and it must be written back once the job is done.  jsread is	*/
+/*  -1 if there is no jobserver.					*/
+
+static int jsread = -1, jswrite = -1;
+
+static void jobserver() {
+#ifndef _WIN32
+    SCRATCH char *p, *q;
+    SCRATCH int r, w;
+
+    if (!(p = getenv("MAKEFLAGS"))) return;
+    if ((q = strstr(p,"--jobserver-auth="))) p = q + 17;
+    else if ((q = strstr(p,"--jobserver-fds="))) p = q + 16;
+    else return;
+    if (!strncmp(p,"fifo:",5)) {
+		for (q = p += 5; *q && *q != ' '; ++q);
+		if (!(p = strndup(p,q - p))) return;
+		if ((r = open(p,O_RDWR)) >= 0) jsread = jswrite = r;
+		free(p);
+    }
+    else if (sscanf(p,"%d,%d",&r,&w) == 2 && fcntl(r,F_GETFD) != -1 &&
+		fcntl(w,F_GETFD) != -1) { jsread = r;  jswrite = w; }
+#endif
+    return;
+}
+
+/*  Takes a token from the jobserver into *tok, waiting for one if	*/
+/*  need be.  Returns FALSE if there is no jobserver.			*/
+
+static int take(char *tok) {
+#ifndef _WIN32
+    struct pollfd pf;
+    ssize_t n;
+
+    if (jsread < 0) return FALSE;
+    for (;;) {
+		if ((n = read(jsread,tok,1)) == 1) return TRUE;
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0 && errno == EAGAIN) {
+			pf.fd = jsread;  pf.events = POLLIN;
+			poll(&pf,1,-1);
+			continue;
+		}
+		return FALSE;
+    }
+#else
+    return FALSE;
+#endif
+}
+
+/*  Gives a token back to the jobserver.				*/
+
+static void give(char tok) {
+#ifndef _WIN32
+    while (write(jswrite,&tok,1) < 0 && errno == EINTR);
+#endif
+    return;
+}
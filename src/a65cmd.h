@@ -0,0 +1,80 @@
+#ifndef A65CMD_H
+#define A65CMD_H
+
+/*
+			  6502 Cross-Assembler in Portable C
+
+		   Copyright (c) 1986 William C. Colley, III
+
+This header file contains the function definitions for the a65n command's
+command line parser, batch mode driver, assembler daemon and its client, and
+watch mode.
+*/
+
+#include "a65n.h"
+
+/*  Batch mode job.  Each line of the manifest is a job, and its words	*/
+/*  are parsed like a command line into the job's context.		*/
+
+typedef struct {
+    A65CTX ctx;
+    char *words;
+    int result, done;
+} JOB;
+
+/*  A file being watched in watch mode, by the inotify watch on its	*/
+/*  directory and its name there.					*/
+
+typedef struct {
+    int wd;
+    char *name;
+} WATCH;
+
+/*  Options of the command itself rather than of an assembly.		*/
+
+typedef struct {
+    char *manifest;		/*  -m:  batch mode manifest file	*/
+    unsigned jobs;		/*  -j:  jobs, or pass 2 threads	*/
+    int daemon;			/*  -d:  run as the assembler daemon	*/
+    int watch;			/*  -w:  assemble again on every change	*/
+} CMDOPTS;
+
+/*  Command line parsing routine.  The arguments are parsed into ctx	*/
+/*  and cmd.  The options that go into cmd are illegal if cmd is NULL	*/
+/*  (as it is for the lines of a manifest).				*/
+
+void options(int argc, char **argv, A65CTX *ctx, CMDOPTS *cmd);
+
+
+/*  Batch mode driver.  The jobs listed in the manifest are assembled	*/
+/*  on a pool of threads, jobs at a time (0 for one per processor),	*/
+/*  and the messages of each job are printed in manifest order.  ctx	*/
+/*  holds the options the command line gave for every job.  Returns	*/
+/*  the total number of lines with errors, or -1 if any job stopped on	*/
+/*  a fatal error.							*/
+
+int batch(A65CTX *ctx, char *manifest, unsigned jobs);
+
+
+/*  Assembler daemon.  Assembly requests from a65n commands are taken	*/
+/*  one at a time on a local socket and run in this process, so the	*/
+/*  source file cache and the assembler's tables stay warm between	*/
+/*  them.  Runs until killed, unless the socket can't be set up.	*/
+
+void serve();
+
+
+/*  Daemon client.  If a daemon is listening, the assembly in ctx is	*/
+/*  sent to it, its messages are printed, and TRUE is returned with	*/
+/*  its result in *result.  Otherwise FALSE is returned.		*/
+
+int forward(A65CTX *ctx, int *result);
+
+
+/*  Watch mode.  The assembly in ctx is run, and run again each time	*/
+/*  one of the files it read changes.  Runs until killed, unless the	*/
+/*  files can't be watched.						*/
+
+void watch(A65CTX *ctx);
+
+#endif
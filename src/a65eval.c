@@ -11,8 +11,14 @@ arithmetic expressions.
 */
 
 #include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define	A65_SSE2
+#endif
+
 /*  Get global goodies:  */
 
 #include "a65.h"
@@ -21,21 +27,44 @@ arithmetic expressions.
 
 /*  Get access to global mailboxes defined in A65.C:			*/
 
-extern char line[];
-extern char lastglobal[];
-extern int filesp, forwd, forceabs, pass;
-extern unsigned argattr, pc;
-extern FILE_INFO filestk[];
-extern FILE *source;
-extern TOKEN token;
+extern THREAD char line[];
+extern THREAD char *lastglobal;
+extern THREAD int filesp, fixok, forwd, forceabs, onepass, pass, replay, unresolved, worker;
+extern THREAD unsigned argattr, inproc, pc, reloc, sect;
+extern THREAD FILE_INFO filestk[], *source;
+extern THREAD LINEREC *lexline;
+extern THREAD TOKEN token;
 
 /* Static function definitions: */
 static unsigned eval(unsigned pre);
+static unsigned binary(unsigned u, unsigned pre);
+static unsigned unop(unsigned op, unsigned u);
+static unsigned binop(unsigned op, unsigned u, unsigned v);
+static unsigned relop(unsigned op, unsigned u, unsigned v);
+static unsigned strip(unsigned u);
+static unsigned xeval(unsigned pre);
+static void emit(unsigned op, unsigned valu, SYMBOL *sym);
+static unsigned run(EXPREC *e, int late, int seen);
 static void exp_error(char c);
+static void lex_error(char c);
+static void keep(SYMBOL *sym);
+static void endrec();
+static void startrec();
+static int play();
 static void make_number(unsigned base);
-static int isnum(char c);
-static int ishex(char c);
-static int isalphnum(char c);
+static void classify();
+static char *skipblank(char *p, char *end);
+static char *findeol(char *p, char *end);
+
+/*  Character classification.  chclass[] holds the CC_ bits of each	*/
+/*  character, and digval[] the value each character would have as a	*/
+/*  digit (which only means something for the hexadecimal digits).	*/
+
+static THREAD unsigned char chclass[256];
+static THREAD unsigned digval[256];
+
+#define	isnum(c)		(chclass[(c) & 0377] & CC_NUM)
+#define	isalphnum(c)	(chclass[(c) & 0377] & (CC_ALPH + CC_NUM))
 
 /*  Machine opcode argument field parsing routine.  The token stream	*/
 /*  from the lexical analyzer is processed to extract addressing mode	*/
@@ -45,15 +74,15 @@ static int isalphnum(char c);
 /*  should not base certain decisions on the result of the evaluation.	*/
 /*  The address is passed back as the return value of the function.	*/
 /*  The addressing mode information is passed back through the global	*/
-/*  mailbox argattr.							*/
+/*  mailbox argattr, and the base the address is relative to (see	*/
+/*  RELBASE in A65.H) through reloc.					*/
 
-static int bad;
+static THREAD int bad;
 
 unsigned do_args() {
-    SCRATCH int c;
     SCRATCH unsigned u;
 
-    argattr = ARGNUM;  u = 0;  bad = FALSE;
+    argattr = ARGNUM;  u = reloc = 0;  bad = FALSE;
     switch (lex() -> attr & TYPE) {
 	case REG:
 		if (token.valu == 'A') argattr = ARGA;
@@ -78,7 +107,7 @@ unsigned do_args() {
 
 	case OPR:
 		if (token.valu == '(') {
-			bad = FALSE;  u = eval(START2);
+			bad = FALSE;  u = xeval(START2);
 			switch (lex() -> attr & TYPE) {
 			case EOL:
 				exp_error('(');
@@ -90,25 +119,27 @@ unsigned do_args() {
 				else if ((lex() -> attr & TYPE) != OPR || token.valu != ')')
 					exp_error('(');
 				else argattr += (ARGX + ARGIND);
-				return bad ? 0 : u;
+				return strip(bad ? 0 : u);
 
 			case OPR:
-				argattr = (ARGIND + ARGNUM);  trash();
-				if ((c = popc()) == '\n') return u;
-				if (c == ',') {
+				argattr = (ARGIND + ARGNUM);
+				if ((lex() -> attr & TYPE) == EOL) return strip(u);
+				if ((token.attr & TYPE) == SEP) {
 					if (((lex() -> attr) & TYPE) != REG || token.valu != 'Y')
 						exp_error('S');
 					else argattr += ARGY;
-					return bad ? 0 : u;
+					return strip(bad ? 0 : u);
 				}
-				argattr = ARGNUM;  pushc(c);
-				token.attr = VAL;  token.valu = u;
+				argattr = ARGNUM;  unlex();
+				u = binary(u,START);
+				goto have_value;
 			}
 		}
 
 	case VAL:
 	case STR:   
-		unlex();  u = eval(START);
+		unlex();  u = xeval(START);
+have_value:
 		if ((token.attr & TYPE) != SEP) {
 			if ((token.attr & TYPE) != EOL) exp_error('S');
 			break;
@@ -120,7 +151,7 @@ have_number:
 		    else argattr += (token.valu == 'X' ? ARGX : ARGY);
 		    break;
     }
-    return bad ? 0 : u;
+    return strip(bad ? 0 : u);
 }
 
 /*  Expression analysis routine.  The token stream from the lexical	*/
@@ -128,17 +159,25 @@ have_number:
 /*  unsigned value.  If an error occurs during the evaluation, the	*/
 /*  global flag	forwd is set to indicate to the line assembler that it	*/
 /*  should not base certain decisions on the result of the evaluation.	*/
+/*  The base the value is relative to is passed back through reloc.	*/
 
 unsigned expr() {
     SCRATCH unsigned u;
 
     bad = FALSE;
-    u = eval(START);
-    return bad ? 0 : u;
+    u = xeval(START);
+    return strip(bad ? 0 : u);
+}
+
+/*  Splits the base a value is relative to off into reloc.		*/
+
+static unsigned strip(unsigned u) {
+    reloc = u & RELBITS;
+    return word(u);
 }
 
 static unsigned eval(unsigned pre) {
-   register unsigned op, u, v;
+   register unsigned op, u;
 
 	for (;;) {
 		u = op = lex()->valu;
@@ -152,82 +191,156 @@ static unsigned eval(unsigned pre) {
 
 		case OPR:
 			if (!(token.attr & UNARY)) { exp_error('E');  break; }
-			u = (op == '*' ? pc : eval((op == '+' || op == '-') ? (unsigned)UOP1 : token.attr & PREC));
-			switch (op) {
-				case '-':   u = word(~u + 1);	break;
-				case NOT:   u ^= 0xffff;		break;
-				case HIGH:  u = high(u);		break;
-				case LOW:   u = low(u);			break;
+			if (op == '*') { u = pc | sect;  emit(XPC,0,NULL); }
+			else {
+				u = eval((op == '+' || op == '-') ? (unsigned)UOP1 : token.attr & PREC);
+				if (op == '-' || op == NOT || op == HIGH || op == LOW) {
+					u = unop(op,u);  emit(XUNARY,op,NULL);
+				}
 			}
+			return binary(u,pre);
 
 		case VAL:
 		case STR:
-			for (;;) {
-				op = lex()->valu;
-				switch (token.attr & TYPE) {
-				case REG:
-				case IMM:	exp_error('S');  break;
-
-				case SEP:
-					if (pre != START) unlex();
-				case EOL:
-					if (pre == LPREN) exp_error('(');
-					return u;
-
-				case STR:
-				case VAL:	exp_error('E');  break;
-
-				case OPR:
-					if (!(token.attr & BINARY)) {
-						exp_error('E');  break;
-					}
-					if ((token.attr & PREC) >= pre) {
-						unlex();  return u;
-					}
-					if (op != ')') {
-						v = eval(token.attr & PREC);
-					}
-					switch (op) {
-						case '+':   u += v;		break;
-						case '-':   u -= v;		break;
-						case '*':   u *= v;		break;
-						case '/':   u /= v;		break;
-						case MOD:   u %= v;		break;
-						case AND:   u &= v;		break;
-						case OR:    u |= v;		break;
-						case XOR:   u ^= v;		break;
-						case '<':   u = u < v;	break;
-						case LE:    u = u <= v;	break;
-						case '=':   u = u == v;	break;
-						case GE:    u = u >= v;	break;
-						case '>':   u = u > v;  break;
-						case NE:    u = u != v;	break;
-						case SHL:
-							if (v > 15) exp_error('E');
-							else u <<= v;
-							break;
-
-						case SHR:
-							if (v > 15) exp_error('E');
-							else u >>= v;
-							break;
-
-						case ')':
-							if (pre == LPREN) return u;
-							exp_error('(');
-							break;
-					}
-					clamp(u);
-					break;
-				}
+			if (token.sym) {
+				u |= token.sym -> rel;
+				emit(XSYM,(token.sym -> attr & PEND ? XWAIT : 0) |
+					(token.sym -> attr ? 0 : XAHEAD),token.sym);
+			}
+			else emit(XCONST,u,NULL);
+			return binary(u,pre);
+		}
+	}
+}
+
+/*  Apply the binary operators that follow the left operand u, down to	*/
+/*  precedence pre.							*/
+
+static unsigned binary(unsigned u, unsigned pre) {
+   register unsigned op, v;
+
+	for (;;) {
+		op = lex()->valu;
+		switch (token.attr & TYPE) {
+		case REG:
+		case IMM:	exp_error('S');  break;
+
+		case SEP:
+			if (pre != START) unlex();
+		case EOL:
+			if (pre == LPREN) exp_error('(');
+			return u;
+
+		case STR:
+		case VAL:	exp_error('E');  break;
+
+		case OPR:
+			if (!(token.attr & BINARY)) {
+				exp_error('E');  break;
+			}
+			if ((token.attr & PREC) >= pre) {
+				unlex();  return u;
+			}
+			if (op == ')') {
+				if (pre == LPREN) return u;
+				exp_error('(');
+			}
+			else {
+				v = eval(token.attr & PREC);
+				u = binop(op,u,v);  emit(XBINARY,op,NULL);
 			}
 			break;
 		}
 	}
 }
 
+/*  Operator routines shared by the parser, the constant folder, and	*/
+/*  the compiled code.							*/
+
+static unsigned unop(unsigned op, unsigned u) {
+    if (u & RELBITS) {
+		if (!(u & RELPART) && (op == HIGH || op == LOW))
+			return u | (op == HIGH ? RELHIGH : RELLOW);
+		exp_error('X');  return word(u);
+    }
+    switch (op) {
+	case '-':   u = word(~u + 1);	break;
+	case NOT:   u ^= 0xffff;		break;
+	case HIGH:  u = high(u);		break;
+	case LOW:   u = low(u);			break;
+    }
+    return u;
+}
+
+static unsigned binop(unsigned op, unsigned u, unsigned v) {
+    if ((u | v) & RELBITS) return relop(op,u,v);
+    switch (op) {
+	case '+':   u += v;		break;
+	case '-':   u -= v;		break;
+	case '*':   u *= v;		break;
+	case '/':   u /= v;		break;
+	case MOD:   u %= v;		break;
+	case AND:   u &= v;		break;
+	case OR:    u |= v;		break;
+	case XOR:   u ^= v;		break;
+	case '<':   u = u < v;	break;
+	case LE:    u = u <= v;	break;
+	case '=':   u = u == v;	break;
+	case GE:    u = u >= v;	break;
+	case '>':   u = u > v;  break;
+	case NE:    u = u != v;	break;
+	case SHL:
+		if (v > 15) exp_error('E');
+		else u <<= v;
+		break;
+
+	case SHR:
+		if (v > 15) exp_error('E');
+		else u >>= v;
+		break;
+    }
+    return clamp(u);
+}
+
+/*  Binary operators on values relative to a base.  A constant can be	*/
+/*  added to or taken from such a value, and two values relative to	*/
+/*  the same base can be taken one from the other.  Anything else	*/
+/*  draws an X error.							*/
+
+static unsigned relop(unsigned op, unsigned u, unsigned v) {
+    if (!((u | v) & RELPART)) {
+		if (op == '+' && !(u & RELBITS && v & RELBITS))
+			return word(u + v) | ((u | v) & RELBASE);
+		if (op == '-' && !(v & RELBITS)) return word(u - v) | (u & RELBASE);
+		if (op == '-' && (u & RELBASE) == (v & RELBASE)) return word(u - v);
+    }
+    exp_error('X');
+    return 0;
+}
+
+/*  Compiled expression storage.  xcomp is set while an expression is	*/
+/*  being compiled (its code starts at xbase), and xfail once it has	*/
+/*  drawn an error that rules it out.  ecur/eend bound the compiled	*/
+/*  expressions of the line pass 2 is replaying.			*/
+
+static THREAD XCODE *xcode = NULL;
+static THREAD EXPREC *exps = NULL;
+static THREAD unsigned long nxcode = 0, xcodesize = 0, xbase;
+static THREAD unsigned long nexps = 0, expsize = 0, ecur = 0, eend = 0;
+static THREAD int xcomp = FALSE, xfail;
+
 static void exp_error(char c) {
     forwd = bad = TRUE;  error(c);
+    if (c != 'U') xfail = TRUE;
+}
+
+/*  Errors found while chopping up the characters of a token are kept	*/
+/*  with the token in the token cache so that pass 2 can repeat them.	*/
+
+static THREAD char lexerr;
+
+static void lex_error(char c) {
+    lexerr = c;  exp_error(c);
 }
 
 /*  Lexical analyzer.  The source input character stream is chopped up	*/
@@ -236,17 +349,51 @@ static void exp_error(char c) {
 /*  to an attribute word, a numeric value, and (possibly) a string	*/
 /*  value.								*/
 
-static int oldt = FALSE;
-static int quote = FALSE;
-static char namebuf[MAXLINE];
+static THREAD int oldt = FALSE;
+static THREAD int quote = FALSE;
+static THREAD int oldc, eol;
+static THREAD char *lptr, *rptr = NULL, rbuf[MAXLINE + 1];
+static THREAD char namebuf[MAXLINE];
+
+/*  Token cache storage.  lexrec is set while pass 1 is recording, and	*/
+/*  tokp/tokend bound the tokens of the line pass 2 is replaying (tokp	*/
+/*  is NULL when the line has to be read from its characters).		*/
+
+static THREAD int lexrec = FALSE;
+static THREAD LINEREC *lines = NULL;
+static THREAD TOKREC *toks = NULL, *tokp = NULL, *tokend = NULL;
+static THREAD unsigned long nlines = 0, linesize = 0, ntoks = 0, toksize = 0, lcur;
+static THREAD FILE_INFO *recsrc;
+static THREAD char *recfile = NULL;
+static THREAD int eofline = 0;
 
 TOKEN *lex() {
 	SCRATCH char c, *p;
 	SCRATCH unsigned b;
 	SCRATCH OPCODE *o;
 	SCRATCH SYMBOL *s;
+	SCRATCH TOKREC *t;
 
 	if (oldt) { oldt = FALSE;  return &token; }
+	token.sym = NULL;
+	if (tokp) {
+		token.sval = "";
+		if (tokp == tokend) { token.attr = EOL;  return &token; }
+		t = tokp++;
+		token.attr = t -> attr;  token.valu = t -> valu;
+		if ((t -> attr & TYPE) == STR) token.sval = t -> p.str;
+		else if ((s = token.sym = t -> p.sym)) {
+			token.sval = s -> sname;  token.valu = s -> valu;
+			if (!s -> attr) { if (inproc != NOPROC || !dropped(s)) exp_error('U'); }
+			else if (worker && s -> attr & PEND) handback();
+			else if ((pass == 2 && (worker ? t -> attr & AHEAD : s -> attr & FORWD)) ||
+				s -> attr & PEND || t -> attr & FORWD) forwd = TRUE;
+			token.attr &= ~(FORWD + AHEAD);
+		}
+		if (t -> err) exp_error(t -> err);
+		return &token;
+	}
+	token.sval = token.sbuf;  lexerr = '\0';  s = NULL;
 	trash();
 	if (isalph(c = popc())) {
 		pushc(c);  pops(token.sval);
@@ -259,16 +406,29 @@ TOKEN *lex() {
 
 			/* handle local label */
 			if (token.sval[0] == '.') {
-				strcpy(namebuf, token.sval);
-				strcpy(token.sval, lastglobal);
-				strcat(token.sval, namebuf);
+				if ((s = lexrec ? new_local(lastglobal, token.sval) :
+					find_local(lastglobal, token.sval))) token.sval = s -> sname;
+				else {
+					strcpy(namebuf, token.sval);
+					strcat(strcpy(token.sval, lastglobal), namebuf);
+				}
 			}
+			else s = lexrec ? new_symbol(token.sval) : find_symbol(token.sval);
+			token.sym = s;
+			if (s && lexrec) refer(s);
 
-			if ((s = find_symbol(token.sval))) {
+			if (s && s -> attr) {
 				token.valu = s -> valu;
-				if (pass == 2 && s -> attr & FORWD) forwd = TRUE;
+				/* in single-pass mode, an EQU still waiting is a forward reference */
+				if (onepass && s -> attr & PEND) {
+					if (fixok) unresolved = forwd = TRUE;
+					else exp_error('U');
+				}
+				else if ((pass == 2 && s -> attr & FORWD) || s -> attr & PEND)
+					forwd = TRUE;
 			}
-			else exp_error('U');
+			else if (fixok) unresolved = forwd = TRUE;
+			else if (inproc != NOPROC || !s || !dropped(s)) exp_error('U');
 		}
 	}
 	else if (isnum(c)) {
@@ -344,7 +504,7 @@ opr2:		    token.attr = BINARY + RELAT + OPR;
 	case '\'':
 	case '"':   quote = TRUE;  token.attr = STR;
 				for (p = token.sval; (*p = popc()) != c; ++p)
-				if (*p == '\n') { exp_error('"');  break; }
+				if (*p == '\n') { lex_error('"');  break; }
 				*p = '\0';  quote = FALSE;
 				if ((token.valu = token.sval[0]) && token.sval[1])
 					token.valu = (token.valu << 8) + token.sval[1];
@@ -356,6 +516,7 @@ opr2:		    token.attr = BINARY + RELAT + OPR;
 	case '\n':  token.attr = EOL;
 				break;
     }
+    if (lexrec && (token.attr & TYPE) != EOL) keep(s);
     return &token;
 }
 
@@ -366,28 +527,71 @@ static void make_number(unsigned base) {
     token.attr = VAL;
     token.valu = 0;
     for (p = token.sval; *p; ++p) {
-		d = toupper(*p) - (isnum(*p) ? '0' : 'A' - 10);
+		d = digval[*p & 0377];
 		token.valu = token.valu * base + d;
-		if (!ishex(*p) || d >= base) { exp_error('D');  break; }
+		if (!(chclass[*p & 0377] & CC_HEX) || d >= base) {
+			lex_error('D');  break;
+		}
     }
     clamp(token.valu);
     return;
 }
 
-int isalph(char c) {
-    return (c >= 'A' && c <= '~') || c == '&' || c == '.' || c == ':' || c == '?';
+/*  Character class table setup.					*/
+
+static void classify() {
+    SCRATCH int c;
+
+    for (c = 0; c < 256; ++c) {
+		if ((c >= 'A' && c <= '~') || c == '&' || c == '.' || c == ':' ||
+			c == '?') chclass[c] |= CC_ALPH;
+		if (c >= '0' && c <= '9') chclass[c] |= CC_NUM + CC_HEX;
+		if (toupper(c) >= 'A' && toupper(c) <= 'F') chclass[c] |= CC_HEX;
+		if (c == ' ' || c == '\t') chclass[c] |= CC_BLANK;
+		digval[c] = toupper(c) - (c >= '0' && c <= '9' ? '0' : 'A' - 10);
+    }
+    return;
 }
 
-static int isnum(char c) {
-    return c >= '0' && c <= '9';
+int isalph(char c) {
+    return chclass[c & 0377] & CC_ALPH;
 }
 
-static int ishex(char c) {
-    return isnum(c) || ((c = toupper(c)) >= 'A' && c <= 'F');
+/*  Scanning routines for runs of source text.  skipblank() returns a	*/
+/*  pointer to the first character from p on that isn't a blank or	*/
+/*  tab, and findeol() to the first \n.  Both return end if they run	*/
+/*  out of text.  Where SSE2 is available, 16 characters at a time are	*/
+/*  checked.								*/
+
+static char *skipblank(char *p, char *end) {
+#ifdef A65_SSE2
+    SCRATCH __m128i v;
+    SCRATCH unsigned m;
+
+    for (; end - p >= 16; p += 16) {
+		v = _mm_loadu_si128((__m128i *)p);
+		m = _mm_movemask_epi8(_mm_or_si128(
+			_mm_cmpeq_epi8(v,_mm_set1_epi8(' ')),
+			_mm_cmpeq_epi8(v,_mm_set1_epi8('\t')))) ^ 0xffff;
+		if (m) return p + __builtin_ctz(m);
+    }
+#endif
+    while (p < end && chclass[*p & 0377] & CC_BLANK) ++p;
+    return p;
 }
 
-static int isalphnum(char c) {
-    return isalph(c) || isnum(c);
+static char *findeol(char *p, char *end) {
+#ifdef A65_SSE2
+    SCRATCH unsigned m;
+
+    for (; end - p >= 16; p += 16) {
+		m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)p),
+			_mm_set1_epi8('\n')));
+		if (m) return p + __builtin_ctz(m);
+    }
+#endif
+    while (p < end && *p != '\n') ++p;
+    return p;
 }
 
 /*  Push back the current token into the input stream.  One level of	*/
@@ -402,7 +606,17 @@ void unlex() {
 /*  current token.  Leading blank space is trashed.			*/
 
 void pops(char *s) {
+    SCRATCH char *p, *end;
+
     trash();
+    if (!oldc && !eol && !rptr) {
+		end = source -> sf -> text + source -> sf -> len;
+		for (p = source -> ptr; p < end && isalphnum(*p); ++p);
+		memcpy(s,source -> ptr,p - source -> ptr);
+		memcpy(lptr,source -> ptr,p - source -> ptr);
+		s += p - source -> ptr;  lptr += p - source -> ptr;
+		source -> ptr = p;
+    }
     for (; isalphnum(*s = popc()); ++s);
     pushc(*s);  *s = '\0';
     return;
@@ -411,8 +625,13 @@ void pops(char *s) {
 /*  Trash blank space and push back the character following it.		*/
 
 void trash() {
-    SCRATCH char c;
+    SCRATCH char c, *p;
 
+    if (!oldc && !eol && !rptr) {
+		p = skipblank(source -> ptr,source -> sf -> text + source -> sf -> len);
+		memcpy(lptr,source -> ptr,p - source -> ptr);
+		lptr += p - source -> ptr;  source -> ptr = p;
+    }
     while ((c = popc()) == ' ');
     pushc(c);
     return;
@@ -424,18 +643,29 @@ void trash() {
 /*  Semicolon is mapped to \n.  In addition, a copy of all input is set	*/
 /*  up in a line buffer for the benefit of the listing.			*/
 
-static int oldc, eol;
-static char *lptr;
+static int getsrc() {
+    if (rptr) return *rptr ? *rptr++ & 0377 : EOF;
+    if (source -> ptr < source -> sf -> text + source -> sf -> len)
+		return *source -> ptr++ & 0377;
+    source -> eof = TRUE;
+    return EOF;
+}
 
 int popc() {
     SCRATCH int c;
+    SCRATCH char *p;
 
     if (oldc) { c = oldc;  oldc = '\0';  return c; }
     if (eol) return '\n';
     for (;;) {
-		if ((c = getc(source)) != EOF && (c &= 0377) == ';' && !quote) {
-			do *lptr++ = c;
-			while ((c = getc(source)) != EOF && (c &= 0377) != '\n');
+		if ((c = getsrc()) != EOF && (c &= 0377) == ';' && !quote) {
+			*lptr++ = c;
+			if (!rptr) {
+				p = findeol(source -> ptr,source -> sf -> text + source -> sf -> len);
+				memcpy(lptr,source -> ptr,p - source -> ptr);
+				lptr += p - source -> ptr;  source -> ptr = p;
+			}
+			while ((c = getsrc()) != EOF && (c &= 0377) != '\n') *lptr++ = c;
 		}
 		if (c == EOF) c = '\n';
 		if ((*lptr++ = c) >= ' ' && c <= '~') return c;
@@ -452,21 +682,402 @@ void pushc(char c) {
     return;
 }
 
+/*  Return the position in the line buffer of the next character that	*/
+/*  popc() will pass back.  Only meaningful when no token is pushed	*/
+/*  back.								*/
+
+unsigned linepos() {
+    return (lptr - line) - (oldc ? 1 : 0);
+}
+
+/*  Begin reading a saved copy of a source line instead of the source	*/
+/*  file.  The line must end with \n.  A NULL pointer goes back to	*/
+/*  the source file.  The line buffer is left alone.			*/
+
+void rescan(char *s) {
+    oldc = '\0';  lptr = rbuf;  rptr = s;
+    oldt = eol = FALSE;  tokp = NULL;
+    return;
+}
+
+/*  Skip the rest of the current source line.				*/
+
+void flush() {
+    if (replay) { oldc = '\0';  oldt = FALSE;  eol = TRUE;  return; }
+    if (lexrec) lexline -> untok = TRUE;
+    while (popc() != '\n');
+    return;
+}
+
+/*  Skip the whole current source line if it can't be an IF, ELSE, or	*/
+/*  ENDI.  Only the label field and the first two characters of the	*/
+/*  opcode field are looked at.  Returns TRUE if the line was skipped.	*/
+/*  Anything the character-at-a-time reader would treat specially	*/
+/*  (control characters and such) sends the line back to it.		*/
+
+#define	isodd(c)	(((c) & 0377) > '~' || \
+	(((c) & 0377) < ' ' && (c) != '\t' && (c) != '\n'))
+
+int skipline() {
+    SCRATCH char *p, *end;
+    SCRATCH int c, d;
+
+    if (oldc || eol || rptr) return FALSE;
+    end = source -> sf -> text + source -> sf -> len;
+    p = source -> ptr;
+    if (p < end && isalph(*p)) {
+		while (++p < end && isalphnum(*p));
+		if (p < end && !(chclass[*p & 0377] & CC_BLANK) && *p != '\n' &&
+			*p != ';') return FALSE;
+    }
+    else for (; p < end && !(chclass[*p & 0377] & CC_BLANK) && *p != '\n' &&
+		*p != ';'; ++p) if (isodd(*p)) return FALSE;
+    p = skipblank(p,end);
+    if (p < end && *p != '\n' && *p != ';') {
+		c = toupper(*p & 0377);  d = p + 1 < end ? p[1] : '\n';
+		if (isodd(*p) || isodd(d)) return FALSE;
+		d = toupper(d & 0377);
+		if ((c == 'I' && d == 'F') || (c == 'E' && (d == 'L' || d == 'N')))
+			return FALSE;
+    }
+    p = findeol(source -> ptr,end);
+    memcpy(lptr,source -> ptr,p - source -> ptr);
+    lptr += p - source -> ptr;  *lptr++ = '\n';  *lptr = '\0';
+    if (p < end) source -> ptr = p + 1;
+    else { source -> ptr = end;  source -> eof = TRUE; }
+    eol = TRUE;
+    return TRUE;
+}
+
+/*  Finish the current source line.  Anything left in the argument	*/
+/*  field draws a T error.						*/
+
+void endline() {
+    SCRATCH int c;
+
+    if (tokp) { if (tokp < tokend) error('T'); }
+    else if (lexrec) {
+		oldt = FALSE;
+		while ((lex() -> attr & TYPE) != EOL) error('T');
+    }
+    else while ((c = popc()) != '\n') if (c != ' ') error('T');
+    return;
+}
+
+/*  Begin a pass over the source file.  Pass 1 of a two-pass assembly	*/
+/*  records the token cache, and pass 2 replays it.			*/
+
+void startpass() {
+    if (!chclass['0']) classify();
+    endrec();
+    source = filestk;  rptr = NULL;  tokp = NULL;
+    filestk[0].ptr = filestk[0].sf -> text;  filestk[0].eof = FALSE;
+    lexrec = pass == 1 && !onepass;  replay = pass == 2;
+    lexline = NULL;  lcur = 0;
+    if (lexrec && !toks) {
+		toksize = 4096;
+		if (!(toks = (TOKREC *)malloc(toksize * sizeof(TOKREC))))
+			fatal_error(MEMFULL);
+    }
+    return;
+}
+
+/*  Lexical analyzer clean-up routine.  The token cache and compiled	*/
+/*  expressions are given back, and the analyzer is set up for the	*/
+/*  next assembly.							*/
+
+void endlex() {
+    free(lines);  free(toks);  free(xcode);  free(exps);
+    lines = NULL;  toks = tokp = tokend = NULL;  xcode = NULL;  exps = NULL;
+    nlines = linesize = ntoks = toksize = lcur = 0;
+    nxcode = xcodesize = nexps = expsize = ecur = eend = 0;
+    xcomp = lexrec = oldt = quote = bad = FALSE;  oldc = eol = 0;
+    lptr = rptr = recfile = NULL;  recsrc = NULL;  eofline = 0;
+    return;
+}
+
 /*  Begin new line of source input.  This routine returns non-zero if	*/
 /*  EOF	has been reached on the main source file, zero otherwise.	*/
 
 int newline() {
-	filestk[filesp].linenum++;
-    oldc = '\0';  lptr = line;
+    oldc = '\0';  lptr = line;  rptr = NULL;
     oldt = eol = FALSE;
-    while (feof(source)) {
-		if (ferror(source)) fatal_error(ASMREAD);
+    if (replay) return play();
+	filestk[filesp].linenum++;
+    endrec();
+    while (source -> eof) {
 		if (filesp) {
-			fclose(source);
-			source = filestk[--filesp].fp;
+			source = filestk + --filesp;
 			filestk[filesp].linenum++;
 		}
-		else return TRUE;
+		else { eofline = source -> linenum;  return TRUE; }
     }
+    if (lexrec) startrec();
     return FALSE;
 }
+
+/*  Token cache recording routines.  startrec() opens a record for the	*/
+/*  line about to be read, keep() adds a token to it, and endrec()	*/
+/*  closes it once the whole line has been read.			*/
+
+static void startrec() {
+    SCRATCH LINEREC *r;
+
+    if (nlines == linesize) {
+		linesize = linesize ? linesize * 2 : 1024;
+		if (!(lines = (LINEREC *)realloc(lines,linesize * sizeof(LINEREC))))
+			fatal_error(MEMFULL);
+    }
+    if (!recfile || strcmp(recfile,source -> filename))
+		recfile = intern(source -> filename);
+    lexline = r = lines + nlines++;
+    memset(r,0,sizeof(LINEREC));
+    r -> text = source -> ptr;  r -> file = recfile;
+    r -> linenum = source -> linenum;  r -> filesp = filesp;
+    r -> tok = ntoks;  r -> exp = nexps;  recsrc = source;
+    return;
+}
+
+static void keep(SYMBOL *sym) {
+    SCRATCH TOKREC *t;
+
+    if (ntoks == toksize) {
+		toksize = toksize ? toksize * 2 : 4096;
+		if (!(toks = (TOKREC *)realloc(toks,toksize * sizeof(TOKREC))))
+			fatal_error(MEMFULL);
+    }
+    t = toks + ntoks++;
+    t -> attr = token.attr;  t -> valu = token.valu;  t -> err = lexerr;
+    t -> p.sym = sym;
+    if (sym && sym -> attr & PEND) t -> attr |= FORWD;
+    if (sym && !sym -> attr) t -> attr |= AHEAD;
+    if ((token.attr & TYPE) == STR) t -> p.str = intern(token.sval);
+    return;
+}
+
+static void endrec() {
+    if (lexrec && lexline) {
+		lexline -> len = recsrc -> ptr - lexline -> text;
+		lexline -> ntok = ntoks - lexline -> tok;
+		lexline -> nexp = nexps - lexline -> exp;
+		lexline = NULL;
+    }
+    return;
+}
+
+/*  Token cache replay routine.  The next recorded line is copied into	*/
+/*  the line buffer for the listing, and its tokens are set up for	*/
+/*  lex().  A line pass 1 skipped is read from its characters instead.	*/
+
+static int play() {
+    SCRATCH LINEREC *r;
+    SCRATCH unsigned n;
+
+    if (lcur == nlines) {
+		filesp = 0;  filestk[0].linenum = eofline;
+		return TRUE;
+    }
+    lexline = r = lines + lcur++;
+    filesp = r -> filesp;  filestk[filesp].linenum = r -> linenum;
+    strcpy(filestk[filesp].filename,r -> file);
+    memcpy(line,r -> text,n = r -> len);
+    if (!n || line[n - 1] != '\n') line[n++] = '\n';
+    line[n] = '\0';
+    if (r -> untok) rescan(line + r -> argpos);
+    else {
+		tokp = toks + r -> tok;  tokend = tokp + r -> ntok;
+		ecur = r -> exp;  eend = ecur + r -> nexp;
+    }
+    return FALSE;
+}
+
+/*  Token cache lending routines.  lexlend() hands over the token	*/
+/*  cache pass 1 recorded, and lexborrow() lets a pass 2 worker thread	*/
+/*  replay it.  The worker only reads it, and never gives it back.	*/
+
+void lexlend(LEXCACHE *c) {
+    c -> lines = lines;  c -> toks = toks;  c -> exps = exps;
+    c -> xcode = xcode;  c -> nlines = nlines;
+    return;
+}
+
+void lexborrow(LEXCACHE *c) {
+    lines = c -> lines;  toks = c -> toks;  exps = c -> exps;
+    xcode = c -> xcode;  nlines = c -> nlines;
+    if (!chclass['0']) classify();
+    lexrec = oldt = FALSE;  tokp = NULL;  rptr = NULL;
+    return;
+}
+
+/*  Line record position routines.  lextell() returns how many line	*/
+/*  records have been recorded (pass 1) or replayed (pass 2), and	*/
+/*  lexseek() makes record n the next one pass 2 replays.		*/
+
+unsigned long lextell() {
+    return replay ? lcur : nlines;
+}
+
+void lexseek(unsigned long n) {
+    lcur = n;  tokp = NULL;  oldt = FALSE;
+    return;
+}
+
+/*  Returns FALSE if the line just replayed can't be assembled apart	*/
+/*  from the lines before it:  pass 1 didn't keep its tokens, or it	*/
+/*  uses a label defined by SET, whose value depends on how far pass 2	*/
+/*  has got.								*/
+
+int lexalone() {
+    SCRATCH TOKREC *t;
+
+    if (lexline -> untok) return FALSE;
+    for (t = tokp; t < tokend; ++t)
+		if ((t -> attr & TYPE) == VAL && t -> p.sym && t -> p.sym -> attr & SOFT)
+			return FALSE;
+    return TRUE;
+}
+
+/*  Evaluate an expression, compiling it or running its compiled code	*/
+/*  if there is any.							*/
+
+static unsigned xeval(unsigned pre) {
+    SCRATCH unsigned long pos;
+    SCRATCH EXPREC *e;
+    SCRATCH unsigned u;
+
+    if (tokp) {
+		pos = tokp - toks - (oldt && (token.attr & TYPE) != EOL);
+		while (ecur < eend && exps[ecur].tok < pos) ++ecur;
+		if (ecur == eend || exps[ecur].tok != pos) return eval(pre);
+		e = exps + ecur++;
+		u = run(e,FALSE,oldt && (token.attr & TYPE) == VAL && token.sym);
+		tokp = toks + e -> term;  oldt = FALSE;  lex();
+		if (e -> pushed) unlex();
+		return u;
+    }
+    if (!lexrec || xcomp) return eval(pre);
+    pos = ntoks - (oldt && (token.attr & TYPE) != EOL);
+    xcomp = TRUE;  xfail = FALSE;  xbase = nxcode;
+    u = eval(pre);
+    xcomp = FALSE;
+    if (xfail) { nxcode = xbase;  return u; }
+    if (nexps == expsize) {
+		expsize = expsize ? expsize * 2 : 1024;
+		if (!(exps = (EXPREC *)realloc(exps,expsize * sizeof(EXPREC))))
+			fatal_error(MEMFULL);
+    }
+    e = exps + nexps++;
+    e -> tok = pos;  e -> term = ntoks - ((token.attr & TYPE) != EOL);
+    e -> code = xbase;  e -> ncode = nxcode - xbase;  e -> pushed = oldt;
+    return u;
+}
+
+/*  Add an instruction to the expression being compiled.  An operator	*/
+/*  whose operands are all constants is folded into one constant.	*/
+
+static void emit(unsigned op, unsigned valu, SYMBOL *sym) {
+    SCRATCH XCODE *x;
+
+    if (!xcomp || xfail) return;
+    x = xcode + nxcode;
+    if (op == XUNARY && nxcode > xbase && x[-1].op == XCONST) {
+		x[-1].valu = unop(valu,x[-1].valu);  return;
+    }
+    if (op == XBINARY && nxcode > xbase + 1 && x[-1].op == XCONST &&
+		x[-2].op == XCONST) {
+		x[-2].valu = binop(valu,x[-2].valu,x[-1].valu);  --nxcode;  return;
+    }
+    if (nxcode == xcodesize) {
+		xcodesize = xcodesize ? xcodesize * 2 : 4096;
+		if (!(xcode = (XCODE *)realloc(xcode,xcodesize * sizeof(XCODE))))
+			fatal_error(MEMFULL);
+		x = xcode + nxcode;
+    }
+    x -> op = op;  x -> valu = valu;  x -> sym = sym;  ++nxcode;
+    return;
+}
+
+/*  Run the compiled code of an expression.  A label flagged as waiting	*/
+/*  when the code was compiled counts as forward-referenced unless late	*/
+/*  is set, as it is when the equate resolver runs the code.  seen is	*/
+/*  set if the label the expression starts with was read ahead by the	*/
+/*  caller and pushed back, so that lex() has already reported it if	*/
+/*  it's undefined.  As eval() would, the value is then kept.		*/
+
+static unsigned run(EXPREC *e, int late, int seen) {
+    SCRATCH XCODE *x, *xend;
+    SCRATCH unsigned *sp;
+    SCRATCH SYMBOL *s;
+    static THREAD unsigned stack[MAXLINE];
+
+    for (sp = stack, x = xcode + e -> code, xend = x + e -> ncode; x < xend; ++x) {
+		switch (x -> op) {
+		case XCONST:	*sp++ = x -> valu;  break;
+
+		case XSYM:		s = x -> sym;
+						if (!s -> attr) {
+							if (!seen || x != xcode + e -> code) exp_error('U');
+						}
+						else if (worker && s -> attr & PEND) handback();
+						else if ((pass == 2 && (worker ? x -> valu & XAHEAD :
+							s -> attr & FORWD)) || s -> attr & PEND ||
+							(x -> valu & XWAIT && !late)) forwd = TRUE;
+						*sp++ = s -> valu | s -> rel;
+						break;
+
+		case XPC:		*sp++ = pc | sect;  break;
+
+		case XUNARY:	sp[-1] = unop(x -> valu,sp[-1]);  break;
+
+		case XBINARY:	--sp;  sp[-1] = binop(x -> valu,sp[-1],sp[0]);  break;
+		}
+    }
+    return stack[0];
+}
+
+/*  Equate resolver.  defer() makes the EQU just assembled wait on the	*/
+/*  labels its expression is waiting on, and settle() is called when a	*/
+/*  label gets its value in pass 1 to settle the EQUs waiting on it.	*/
+
+void defer(SYMBOL *sym) {
+    SCRATCH DEFREC *d;
+    SCRATCH XCODE *x, *xend;
+    SCRATCH WAITREC *w;
+    SCRATCH EXPREC *e;
+
+    if (!lexrec || !lexline || nexps == lexline -> exp) return;
+    e = exps + nexps - 1;
+    for (x = xcode + e -> code, xend = x + e -> ncode; x < xend; ++x)
+		if (x -> op == XSYM && x -> sym == sym) return;
+    d = (DEFREC *)arena(sizeof(DEFREC));
+    d -> sym = sym;  d -> exp = e - exps;  d -> pc = pc;  d -> sect = sect;
+    for (x = xcode + e -> code; x < xend; ++x) {
+		if (x -> op == XSYM && (!x -> sym -> attr || x -> sym -> attr & PEND)) {
+			w = (WAITREC *)arena(sizeof(WAITREC));
+			w -> def = d;  w -> next = x -> sym -> wait;  x -> sym -> wait = w;
+			++d -> npend;
+		}
+    }
+    if (d -> npend) sym -> attr |= PEND;
+    return;
+}
+
+void settle(SYMBOL *sym) {
+    WAITREC *w;					/*  settle() recurses, so	*/
+    DEFREC *d;					/*  no SCRATCH here.		*/
+    unsigned u, savepc, savesect;
+    int saveforwd;
+
+    while ((w = sym -> wait)) {
+		sym -> wait = w -> next;
+		if (--(d = w -> def) -> npend) continue;
+		saveforwd = forwd;  savepc = pc;  savesect = sect;
+		pc = d -> pc;  sect = d -> sect;
+		u = run(exps + d -> exp,TRUE,FALSE);
+		forwd = saveforwd;  pc = savepc;  sect = savesect;
+		d -> sym -> valu = word(u);  d -> sym -> rel = u & RELBITS;
+		d -> sym -> attr = (d -> sym -> attr & ~PEND) | LATE;
+		settle(d -> sym);
+    }
+    return;
+}
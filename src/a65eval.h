@@ -78,9 +78,90 @@ int popc();
 void pushc(char c);
 
 
+/*  Return the position in the line buffer of the next character that	*/
+/*  popc() will pass back.  Only meaningful when no token is pushed		*/
+/*  back.																*/
+
+unsigned linepos();
+
+
+/*  Begin reading a saved copy of a source line instead of the source	*/
+/*  file.  The line must end with \n.  A NULL pointer goes back to		*/
+/*  the source file.  The line buffer is left alone.					*/
+
+void rescan(char *s);
+
+
+/*  Skip the rest of the current source line.							*/
+
+void flush();
+
+
+/*  Skip the whole current source line if it can't be an IF, ELSE, or	*/
+/*  ENDI.  Only the label field and the first two characters of the		*/
+/*  opcode field are looked at.  Returns TRUE if the line was skipped.	*/
+
+int skipline();
+
+
+/*  Finish the current source line.  Anything left in the argument		*/
+/*  field draws a T error.												*/
+
+void endline();
+
+
+/*  Begin a pass over the source file.  Pass 1 of a two-pass assembly	*/
+/*  records the token cache, and pass 2 replays it.						*/
+
+void startpass();
+
+
+/*  Lexical analyzer clean-up routine.  The token cache and compiled	*/
+/*  expressions are given back, and the analyzer is set up for the		*/
+/*  next assembly.														*/
+
+void endlex();
+
+
 /*  Begin new line of source input.  This routine returns non-zero if	*/
 /*  EOF	has been reached on the main source file, zero otherwise.		*/
 
 int newline();
 
+
+/*  Token cache lending routines.  lexlend() hands over the token		*/
+/*  cache pass 1 recorded, and lexborrow() lets a pass 2 worker thread	*/
+/*  replay it.  The worker only reads it, and never gives it back.		*/
+
+void lexlend(LEXCACHE *c);
+void lexborrow(LEXCACHE *c);
+
+
+/*  Line record position routines.  lextell() returns how many line		*/
+/*  records have been recorded (pass 1) or replayed (pass 2), and		*/
+/*  lexseek() makes record n the next one pass 2 replays.				*/
+
+unsigned long lextell();
+void lexseek(unsigned long n);
+
+
+/*  Returns FALSE if the line just replayed can't be assembled apart	*/
+/*  from the lines before it:  pass 1 didn't keep its tokens, or it		*/
+/*  uses a label defined by SET, whose value depends on how far pass 2	*/
+/*  has got.															*/
+
+int lexalone();
+
+
+/*  Make the EQU just assembled in pass 1 wait on the labels its		*/
+/*  forward-referenced expression is waiting on.  sym is its label.		*/
+
+void defer(SYMBOL *sym);
+
+
+/*  sym has just got its value in pass 1.  Settle the EQUs waiting on	*/
+/*  it, and in turn the ones waiting on them.							*/
+
+void settle(SYMBOL *sym);
+
 #endif
@@ -0,0 +1,549 @@
+/*
+		      6502 Cross-Assembler in Portable C
+
+		   Copyright (c) 1986 William C. Colley, III
+
+This file contains the linker, a65n-link.  It reads the relocatable object
+files the assembler writes with the -r option, places their sections in
+memory, gives each imported symbol the value another object file exported it
+with, and patches the relocated fields.  The result is a binary file running
+from the lowest address anything was placed at to the highest, just as the
+assembler would write it, and, if asked for, a map of where everything went.
+
+Sections with a fixed address (ones ORG'ed in the source) stay where they are.
+The others are placed by name, in the order the object files first name them:
+the sections of one name go one after another in command line order, and the
+next name follows on after them, unless -s gives it an address of its own.
+If memory regions are given with -r, the sections -s doesn't place are packed
+into whatever space in them is left instead, largest first, each at the lowest
+address it fits at.  Each section starts at a multiple of its alignment.
+*/
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*  Get global goodies:  */
+
+#include "a65link.h"
+
+/* Static function declarations: */
+static void option(char ***argv, int *argc, char **name, char *none, char *two);
+static void placement(char *s);
+static void region(char *s);
+static unsigned long number(char *p, char **q);
+static void readobj(LMOD *m);
+static unsigned long take(LMOD *m, unsigned char **p, unsigned char *end, unsigned n);
+static char *name(LMOD *m, unsigned char **p, unsigned char *end);
+static void resolve();
+static void place();
+static void pack();
+static void carve(unsigned long a, unsigned long b);
+static void check();
+static void relocate();
+static void output(char *nam);
+static void map(char *nam);
+static int symcmp(const void *a, const void *b);
+static int addrcmp(const void *a, const void *b);
+static int sizecmp(const void *a, const void *b);
+static int spancmp(const void *a, const void *b);
+static void *more(void *p, unsigned *size, unsigned n, size_t each);
+static void lerror(LMOD *m, char *msg, char *what);
+static void fatal(char *nam, char *msg);
+
+/*  The object files, their sections in command line order, their	*/
+/*  exports, the -s options, and the -r options (which place() turns	*/
+/*  into the memory still free).					*/
+
+static LMOD *mods = NULL;
+static unsigned nmods = 0;
+static LSECT **sects = NULL;
+static unsigned nsects = 0, sectsize = 0;
+static LSYM *syms = NULL;
+static unsigned nsyms = 0, symsize = 0;
+static LPLACE *places = NULL;
+static unsigned nplaces = 0, placesize = 0;
+static LSPAN *spans = NULL;
+static unsigned nspans = 0, spansize = 0;
+static unsigned errors = 0;
+
+int main(int argc, char **argv) {
+    SCRATCH unsigned i;
+    char *outnam = NULL, *mapnam = NULL, *s;
+
+	printf("6502 Cross-Assembler Linker (Portable)\n");
+	printf("Copyright (c) 1986 William C. Colley, III\n");
+	printf("Copyright (c) 2023-2025 Nathan Misner\n\n");
+
+    if (!(mods = (LMOD *)calloc(argc,sizeof(LMOD)))) fatal(NULL,MEMFULL);
+    while (--argc > 0) {
+		if (**++argv == '-') {
+			switch (toupper(*++*argv)) {
+			case 'M':	option(&argv,&argc,&mapnam,NOMAP,TWOMAP);  break;
+
+			case 'O':	option(&argv,&argc,&outnam,NOHEX,TWOHEX);  break;
+
+			case 'S':	s = NULL;
+						option(&argv,&argc,&s,BADPLACE,NULL);
+						if (s) placement(s);
+						break;
+
+			case 'R':	s = NULL;
+						option(&argv,&argc,&s,BADREGION,NULL);
+						if (s) region(s);
+						break;
+
+			default:	printf("Warning -- %s\n",BADOPT);
+			}
+		}
+		else mods[nmods++].name = *argv;
+    }
+    if (!nmods) fatal(NULL,NOOBJ);
+
+    for (i = 0; i < nmods; ++i) readobj(mods + i);
+    resolve();
+    place();
+    check();
+    relocate();
+    if (outnam) output(outnam);
+    if (mapnam) map(mapnam);
+
+    if (errors) printf("%u Error(s)\n",errors);
+    else printf("No Errors\n");
+    exit(errors);
+}
+
+/*  Picks up the file name of an option, either run onto the option	*/
+/*  letter or in the next argument.  A missing name draws the warning	*/
+/*  none, and a second name for the same file the warning two.	*/
+
+static void option(char ***argv, int *argc, char **name, char *none, char *two) {
+    if (!*++**argv) {
+		if (!--*argc) { printf("Warning -- %s\n",none);  return; }
+		else ++*argv;
+    }
+    if (*name && two) printf("Warning -- %s\n",two);
+    else *name = **argv;
+    return;
+}
+
+/*  Takes a -s option, NAME=ADDRESS.  The address may be decimal, or	*/
+/*  hexadecimal after $ or 0x.						*/
+
+static void placement(char *s) {
+    SCRATCH char *p, *q;
+    SCRATCH unsigned long u;
+
+    if (!(p = strchr(s,'=')) || p == s || !p[1]) { printf("Warning -- %s\n",BADPLACE);  return; }
+    u = number(++p,&q);
+    if (*q || u > 0xffff) { printf("Warning -- %s\n",BADPLACE);  return; }
+    places = (LPLACE *)more(places,&placesize,nplaces,sizeof(LPLACE));
+    p[-1] = '\0';
+    places[nplaces].name = s;  places[nplaces++].addr = u;
+    return;
+}
+
+/*  Takes a -r option, START-END, where END is the last address of the	*/
+/*  region.								*/
+
+static void region(char *s) {
+    SCRATCH char *q;
+    SCRATCH unsigned long lo, hi;
+
+    lo = number(s,&q);
+    if (*q != '-' || (hi = number(q + 1,&q)) > 0xffff || *q || hi < lo) {
+		printf("Warning -- %s\n",BADREGION);  return;
+    }
+    spans = (LSPAN *)more(spans,&spansize,nspans,sizeof(LSPAN));
+    spans[nspans].lo = lo;  spans[nspans++].hi = hi + 1;
+    return;
+}
+
+/*  Converts the number at p, decimal or hexadecimal after $ or 0x.	*/
+/*  *q is left pointing just past it.					*/
+
+static unsigned long number(char *p, char **q) {
+    if (!isdigit((unsigned char)p[*p == '$'])) { *q = p;  return 0x10000; }
+    return *p == '$' ? strtoul(p + 1,q,16) : strtoul(p,q,0);
+}
+
+/*  Reads object file m into memory and picks out its sections and	*/
+/*  exports.  The layout is given in A65.H.  If the file is cut short	*/
+/*  or doesn't make sense, a fatal error occurs.			*/
+
+static void readobj(LMOD *m) {
+    SCRATCH FILE *fp;
+    SCRATCH unsigned char *p, *end, *r;
+    SCRATCH size_t n, size, k;
+    SCRATCH unsigned i, kind, off, b;
+    SCRATCH LBASE *base;
+    SCRATCH LSECT *s;
+    SCRATCH LSYM *y;
+
+    if (!(fp = fopen(m -> name,"rb"))) fatal(m -> name,OBJOPEN);
+    for (m -> text = NULL, n = size = 0; ; n += k) {
+		if (n == size) {
+			size = size ? size * 2 : 65536;
+			if (!(m -> text = (unsigned char *)realloc(m -> text,size))) fatal(NULL,MEMFULL);
+		}
+		if (!(k = fread(m -> text + n,1,size - n,fp))) break;
+    }
+    if (ferror(fp)) fatal(m -> name,OBJOPEN);
+    fclose(fp);
+
+    p = m -> text;  end = p + n;
+    if (n < 8 || memcmp(p,OBJMAGIC,8)) fatal(m -> name,BADOBJ);
+    p += 8;
+    m -> nbase = take(m,&p,end,2);
+    if (!(m -> base = (LBASE *)calloc(m -> nbase + 1,sizeof(LBASE)))) fatal(NULL,MEMFULL);
+    for (base = m -> base; base < m -> base + m -> nbase; ++base) {
+		kind = take(m,&p,end,1);
+		base -> name = name(m,&p,end);
+		if (kind == OBJEXTRN) continue;
+		if (kind != OBJSECT && kind != OBJFIXED) fatal(m -> name,BADOBJ);
+		if (!(s = base -> sect = (LSECT *)calloc(1,sizeof(LSECT)))) fatal(NULL,MEMFULL);
+		s -> name = base -> name;  s -> mod = m;  s -> fixed = kind == OBJFIXED;
+		s -> addr = take(m,&p,end,2);  s -> align = take(m,&p,end,4);
+		if (!s -> align || s -> align > 0x10000) fatal(m -> name,BADOBJ);
+		s -> size = take(m,&p,end,4);  s -> nrel = take(m,&p,end,4);
+		if (s -> size > 0x10000 || s -> size > (unsigned long)(end - p)) fatal(m -> name,BADOBJ);
+		s -> data = p;  p += s -> size;
+		if (s -> nrel > (unsigned long)(end - p) / RELSIZE) fatal(m -> name,BADOBJ);
+		s -> rel = p;  p += s -> nrel * RELSIZE;
+		sects = (LSECT **)more(sects,&sectsize,nsects,sizeof(LSECT *));
+		s -> num = nsects;  sects[nsects++] = s;
+    }
+    for (base = m -> base; base < m -> base + m -> nbase; ++base) {
+		if (!(s = base -> sect)) continue;
+		for (r = s -> rel; r < s -> rel + s -> nrel * RELSIZE; r += RELSIZE) {
+			off = r[0] | r[1] << 8;  b = r[3] | r[4] << 8;
+			if (r[2] > RREL || b > m -> nbase ||
+				off + (r[2] == RWORD ? 2 : 1) > s -> size) fatal(m -> name,BADOBJ);
+		}
+    }
+    n = take(m,&p,end,2);
+    for (i = 0; i < n; ++i) {
+		syms = (LSYM *)more(syms,&symsize,nsyms,sizeof(LSYM));
+		y = syms + nsyms++;
+		y -> name = name(m,&p,end);  y -> mod = m;
+		b = take(m,&p,end,2);  y -> valu = take(m,&p,end,2);
+		if (b > m -> nbase || (b && !m -> base[b - 1].sect)) fatal(m -> name,BADOBJ);
+		y -> sect = b ? m -> base[b - 1].sect : NULL;
+    }
+    return;
+}
+
+/*  Takes an n-byte little-endian number from *p.			*/
+
+static unsigned long take(LMOD *m, unsigned char **p, unsigned char *end, unsigned n) {
+    SCRATCH unsigned long u;
+    SCRATCH unsigned i;
+
+    if ((unsigned)(end - *p) < n) fatal(m -> name,BADOBJ);
+    for (u = i = 0; i < n; ++i) u |= (unsigned long)(*p)[i] << 8 * i;
+    *p += n;
+    return u;
+}
+
+/*  Takes a name, ending with a \0, from *p.				*/
+
+static char *name(LMOD *m, unsigned char **p, unsigned char *end) {
+    SCRATCH unsigned char *q;
+
+    if (!(q = (unsigned char *)memchr(*p,'\0',end - *p))) fatal(m -> name,BADOBJ);
+    q = *p;  *p += strlen((char *)q) + 1;
+    return (char *)q;
+}
+
+/*  Gives each imported symbol the export of the same name.  Two	*/
+/*  exports of one name, and imports with none, are errors.		*/
+
+static void resolve() {
+    SCRATCH unsigned i;
+    SCRATCH LMOD *m;
+    SCRATCH LBASE *b;
+    LSYM key;
+
+    qsort(syms,nsyms,sizeof(LSYM),symcmp);
+    for (i = 1; i < nsyms; ++i)
+		if (!strcmp(syms[i - 1].name,syms[i].name)) lerror(syms[i].mod,MULTDEF,syms[i].name);
+    for (m = mods; m < mods + nmods; ++m)
+		for (b = m -> base; b < m -> base + m -> nbase; ++b) {
+			if (b -> sect) continue;
+			key.name = b -> name;
+			if (!(b -> sym = (LSYM *)bsearch(&key,syms,nsyms,sizeof(LSYM),symcmp)))
+				lerror(m,UNDEF,b -> name);
+		}
+    return;
+}
+
+/*  Places the sections that don't have fixed addresses.  Without -r,	*/
+/*  each name's sections follow on from the last name's.  With it, the	*/
+/*  ones -s doesn't place are left for pack().				*/
+
+#define	alignup(u,a)	(((u) + (a) - 1) / (a) * (a))
+
+static void place() {
+    SCRATCH unsigned i, j;
+    SCRATCH unsigned long at, next;
+    SCRATCH LSECT *s, *t;
+
+    for (next = i = 0; i < nsects; ++i) {
+		if ((s = sects[i]) -> fixed || s -> placed) continue;
+		at = nspans ? 0x10000 : next;
+		for (j = 0; j < nplaces; ++j) if (!strcmp(places[j].name,s -> name)) at = places[j].addr;
+		if (at > 0xffff && nspans) continue;
+		for (j = i; j < nsects; ++j) {
+			if ((t = sects[j]) -> fixed || t -> placed || strcmp(t -> name,s -> name)) continue;
+			t -> addr = at = alignup(at,t -> align);  t -> placed = TRUE;
+			at += t -> size;
+		}
+		next = at;
+    }
+    if (nspans) pack();
+    return;
+}
+
+/*  Packs the sections that aren't placed yet into the -r regions.	*/
+/*  The regions, less the memory the placed sections take up, become	*/
+/*  a list of free spans in address order.  Then, largest section	*/
+/*  first, each section goes at the lowest address in a span it fits	*/
+/*  in, and that much is carved out of the span.			*/
+
+static void pack() {
+    SCRATCH unsigned i, j, n;
+    SCRATCH unsigned long at;
+    SCRATCH LSECT **v, *s;
+
+    qsort(spans,nspans,sizeof(LSPAN),spancmp);
+    for (n = 0, i = 1; i < nspans; ++i) {
+		if (spans[i].lo <= spans[n].hi) {
+			if (spans[i].hi > spans[n].hi) spans[n].hi = spans[i].hi;
+		}
+		else spans[++n] = spans[i];
+    }
+    nspans = n + 1;
+
+    if (!(v = (LSECT **)malloc((nsects + 1) * sizeof(LSECT *)))) fatal(NULL,MEMFULL);
+    for (n = i = 0; i < nsects; ++i) {
+		if ((s = sects[i]) -> fixed || s -> placed) carve(s -> addr,s -> addr + s -> size);
+		else v[n++] = s;
+    }
+    qsort(v,n,sizeof(LSECT *),sizecmp);
+    for (i = 0; i < n; ++i) {
+		s = v[i];
+		for (j = 0; j < nspans; ++j) {
+			at = alignup(spans[j].lo,s -> align);
+			if (at + s -> size <= spans[j].hi) break;
+		}
+		if (j == nspans) { lerror(s -> mod,NOROOM,s -> name);  continue; }
+		s -> addr = at;  s -> placed = TRUE;
+		carve(at,at + s -> size);
+    }
+    free(v);
+    return;
+}
+
+/*  Takes the memory from a up to (but not including) b out of the	*/
+/*  free spans.								*/
+
+static void carve(unsigned long a, unsigned long b) {
+    SCRATCH unsigned i;
+
+    if (a == b) return;
+    for (i = 0; i < nspans; ++i) {
+		if (b <= spans[i].lo || a >= spans[i].hi) continue;
+		if (a > spans[i].lo && b < spans[i].hi) {
+			spans = (LSPAN *)more(spans,&spansize,nspans,sizeof(LSPAN));
+			memmove(spans + i + 1,spans + i,(nspans++ - i) * sizeof(LSPAN));
+			spans[i].hi = a;  spans[++i].lo = b;
+		}
+		else if (a > spans[i].lo) spans[i].hi = a;
+		else if (b < spans[i].hi) spans[i].lo = b;
+		else {
+			memmove(spans + i,spans + i + 1,(--nspans - i) * sizeof(LSPAN));
+			--i;
+		}
+    }
+    return;
+}
+
+/*  Checks that each section fits in memory and none overlap.		*/
+
+static void check() {
+    SCRATCH unsigned i, n;
+    SCRATCH LSECT **v;
+
+    if (!(v = (LSECT **)malloc((nsects + 1) * sizeof(LSECT *)))) fatal(NULL,MEMFULL);
+    for (n = i = 0; i < nsects; ++i) {
+		if (!sects[i] -> fixed && !sects[i] -> placed) continue;
+		if (sects[i] -> addr + sects[i] -> size > 0x10000)
+			lerror(sects[i] -> mod,NOFIT,sects[i] -> name);
+		else if (sects[i] -> size) v[n++] = sects[i];
+    }
+    qsort(v,n,sizeof(LSECT *),addrcmp);
+    for (i = 1; i < n; ++i)
+		if (v[i - 1] -> addr + v[i - 1] -> size > v[i] -> addr)
+			lerror(v[i] -> mod,OVERLAP,v[i] -> name);
+    free(v);
+    return;
+}
+
+/*  Patches the relocated fields of every section.			*/
+
+static void relocate() {
+    SCRATCH unsigned i, off, v;
+    SCRATCH unsigned char *r, *q;
+    SCRATCH LSECT *s;
+    SCRATCH LBASE *b;
+
+    for (i = 0; i < nsects; ++i) {
+		s = sects[i];
+		for (r = s -> rel; r < s -> rel + s -> nrel * RELSIZE; r += RELSIZE) {
+			off = r[0] | r[1] << 8;  v = r[5] | r[6] << 8;
+			if (r[3] | r[4]) {
+				b = s -> mod -> base + (r[3] | r[4] << 8) - 1;
+				if (b -> sect) v += b -> sect -> addr;
+				else if (b -> sym)
+					v += b -> sym -> valu + (b -> sym -> sect ? b -> sym -> sect -> addr : 0);
+			}
+			q = s -> data + off;
+			switch (r[2]) {
+			case RWORD:	q[0] = low(v);  q[1] = high(v);  break;
+
+			case RLOW:	q[0] = low(v);  break;
+
+			case RHIGH:	q[0] = high(v);  break;
+
+			case RREL:	v = word(v - (s -> addr + off + 1));
+						if (v > 0x007f && v < 0xff80) {
+							lerror(s -> mod,FARREL,s -> name);  v = 0xfe;
+						}
+						q[0] = low(v);
+						break;
+			}
+		}
+    }
+    return;
+}
+
+/*  Whether section s was placed, and fits in memory.			*/
+
+#define	inplace(s)	((s) -> size && ((s) -> fixed || (s) -> placed) && \
+			 (s) -> addr + (s) -> size <= 0x10000)
+
+/*  Writes the binary file, from the lowest address placed to the	*/
+/*  highest, with zeroes in the gaps.					*/
+
+static void output(char *nam) {
+    SCRATCH FILE *fp;
+    SCRATCH unsigned i;
+    SCRATCH unsigned long lo, hi;
+    SCRATCH unsigned char *image;
+
+    for (lo = 0x10000, hi = i = 0; i < nsects; ++i) {
+		if (!inplace(sects[i])) continue;
+		if (sects[i] -> addr < lo) lo = sects[i] -> addr;
+		if (sects[i] -> addr + sects[i] -> size > hi) hi = sects[i] -> addr + sects[i] -> size;
+    }
+    if (hi < lo) lo = hi;
+    if (!(image = (unsigned char *)calloc(hi - lo + 1,1))) fatal(NULL,MEMFULL);
+    for (i = 0; i < nsects; ++i) {
+		if (!inplace(sects[i])) continue;
+		memcpy(image + sects[i] -> addr - lo,sects[i] -> data,sects[i] -> size);
+    }
+    if (!(fp = fopen(nam,"wb"))) fatal(nam,OUTOPEN);
+    if (fwrite(image,1,hi - lo,fp) != hi - lo || fclose(fp) == EOF) fatal(nam,DSKFULL);
+    free(image);
+    return;
+}
+
+/*  Writes the map file:  the sections in address order, the memory	*/
+/*  left free in the -r regions, then the exported symbols in name	*/
+/*  order.								*/
+
+static void map(char *nam) {
+    SCRATCH FILE *fp;
+    SCRATCH unsigned i;
+    SCRATCH LSECT **v;
+
+    if (!(fp = fopen(nam,"w"))) fatal(nam,MAPOPEN);
+    if (!(v = (LSECT **)malloc((nsects + 1) * sizeof(LSECT *)))) fatal(NULL,MEMFULL);
+    memcpy(v,sects,nsects * sizeof(LSECT *));
+    qsort(v,nsects,sizeof(LSECT *),addrcmp);
+    fprintf(fp,"Address  Size  Section           Object File\n\n");
+    for (i = 0; i < nsects; ++i) {
+		if (v[i] -> fixed || v[i] -> placed) fprintf(fp,"%04X ",v[i] -> addr);
+		else fprintf(fp,"---- ");
+		fprintf(fp,"  %5lu  %-16s  %s\n",v[i] -> size,v[i] -> name,v[i] -> mod -> name);
+    }
+    if (nspans) {
+		fprintf(fp,"\nFree Memory\n\n");
+		for (i = 0; i < nspans; ++i)
+			fprintf(fp,"%04lX   %5lu\n",spans[i].lo,spans[i].hi - spans[i].lo);
+    }
+    fprintf(fp,"\nValue  Symbol            Object File\n\n");
+    for (i = 0; i < nsyms; ++i)
+		fprintf(fp,"%04X   %-16s  %s\n",
+			word(syms[i].valu + (syms[i].sect ? syms[i].sect -> addr : 0)),
+			syms[i].name,syms[i].mod -> name);
+    free(v);
+    if (ferror(fp) || fclose(fp) == EOF) fatal(nam,DSKFULL);
+    return;
+}
+
+static int symcmp(const void *a, const void *b) {
+    return strcmp(((LSYM *)a) -> name,((LSYM *)b) -> name);
+}
+
+static int addrcmp(const void *a, const void *b) {
+    SCRATCH unsigned x, y;
+
+    x = (*(LSECT **)a) -> addr;  y = (*(LSECT **)b) -> addr;
+    return x < y ? -1 : x > y;
+}
+
+static int sizecmp(const void *a, const void *b) {
+    SCRATCH LSECT *x, *y;
+
+    x = *(LSECT **)a;  y = *(LSECT **)b;
+    if (x -> size != y -> size) return x -> size > y -> size ? -1 : 1;
+    if (x -> align != y -> align) return x -> align > y -> align ? -1 : 1;
+    return x -> num < y -> num ? -1 : x -> num > y -> num;
+}
+
+static int spancmp(const void *a, const void *b) {
+    SCRATCH unsigned long x, y;
+
+    x = ((LSPAN *)a) -> lo;  y = ((LSPAN *)b) -> lo;
+    return x < y ? -1 : x > y;
+}
+
+/*  Makes room in array p (of *size elements of each bytes, n of them	*/
+/*  in use) for one more element.					*/
+
+static void *more(void *p, unsigned *size, unsigned n, size_t each) {
+    if (n == *size) {
+		*size = *size ? *size * 2 : 64;
+		if (!(p = realloc(p,*size * each))) fatal(NULL,MEMFULL);
+    }
+    return p;
+}
+
+/*  Error handler routine.  The error is printed along with the object	*/
+/*  file and the section or symbol it's about, and counted.		*/
+
+static void lerror(LMOD *m, char *msg, char *what) {
+    printf("%s: Error -- %s: %s\n",m -> name,msg,what);
+    ++errors;
+    return;
+}
+
+/*  Fatal error handler routine.  The message is printed, along with	*/
+/*  the name of the file it's about, and the linker stops.		*/
+
+static void fatal(char *nam, char *msg) {
+    if (nam) printf("%s: Fatal Error -- %s\n",nam,msg);
+    else printf("Fatal Error -- %s\n",msg);
+    exit(-1);
+}
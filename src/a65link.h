@@ -0,0 +1,99 @@
+#ifndef A65LINK_H
+#define A65LINK_H
+
+/*
+			  6502 Cross-Assembler in Portable C
+
+		   Copyright (c) 1986 William C. Colley, III
+
+This header file contains the constants and data types of the linker,
+a65n-link.
+*/
+
+#include "a65.h"
+
+/*  The fatal error messages generated by the linker:			*/
+
+#define	BADOBJ		"Bad Object File"
+#define	MAPOPEN		"Map File Did Not Open"
+#define	NOOBJ		"No Object Files Specified"
+#define	OBJOPEN		"Object File Did Not Open"
+#define	OUTOPEN		"Output File Did Not Open"
+
+/*  The errors found while linking:					*/
+
+#define	FARREL		"Branch Target Too Distant"
+#define	MULTDEF		"Multiply Defined Symbol"
+#define	NOFIT		"Section Runs Past $FFFF"
+#define	NOROOM		"No Room For Section"
+#define	OVERLAP		"Sections Overlap"
+#define	UNDEF		"Undefined Symbol"
+
+/*  The warning messages generated by the linker:			*/
+
+#define	BADPLACE	"-s Option Ignored -- Not NAME=ADDRESS"
+#define	BADREGION	"-r Option Ignored -- Not START-END"
+#define	NOMAP		"-m Option Ignored -- No File Name"
+#define	TWOMAP		"Extra Map File Ignored"
+
+/*  Linker object file.  The file is read into memory whole, and the	*/
+/*  names and bytes of its sections are left there.  Its bases are	*/
+/*  numbered from 1 as they are in the file.				*/
+
+typedef struct _lsect LSECT;
+typedef struct _lsym LSYM;
+
+typedef struct {
+    char *name;
+    unsigned char *text;
+    unsigned nbase;
+    struct _lbase *base;
+} LMOD;
+
+/*  A base of an object file:  a section, or an imported symbol and	*/
+/*  the export (if any) it was resolved to.				*/
+
+typedef struct _lbase {
+    char *name;
+    LSECT *sect;
+    LSYM *sym;
+} LBASE;
+
+/*  A section of an object file.  addr is the address it's placed at	*/
+/*  (or fixed at, if fixed is set), which must be a multiple of align.	*/
+/*  num is its place on the command line.				*/
+
+struct _lsect {
+    char *name;
+    LMOD *mod;
+    int fixed, placed;
+    unsigned addr, num;
+    unsigned long align, size, nrel;
+    unsigned char *data, *rel;
+};
+
+/*  An exported symbol.  Its value is relative to its section, or	*/
+/*  absolute if sect is NULL.						*/
+
+struct _lsym {
+    char *name;
+    LMOD *mod;
+    LSECT *sect;
+    unsigned valu;
+};
+
+/*  A -s option:  the sections named name start at addr.		*/
+
+typedef struct {
+    char *name;
+    unsigned addr;
+} LPLACE;
+
+/*  A stretch of memory, from lo up to (but not including) hi:  a -r	*/
+/*  option, or a part of one that's still free.			*/
+
+typedef struct {
+    unsigned long lo, hi;
+} LSPAN;
+
+#endif
@@ -0,0 +1,120 @@
+/*
+		      6502 Cross-Assembler in Portable C
+
+		   Copyright (c) 1986 William C. Colley, III
+
+This file contains the main program of the a65n command.  It parses the
+command line into an assembler context, and has the assembler library run the
+assembly with its messages going to the console.  The assembly goes to the
+assembler daemon instead if one is running.  The command can also hand a
+manifest of jobs to the batch mode driver, watch the source and assemble it
+again whenever it changes, or become the daemon.
+*/
+
+#include <ctype.h>
+#include <stdlib.h>
+
+/*  Get global goodies:  */
+
+#include "a65.h"
+#include "a65cmd.h"
+
+static void option(char ***argv, int *argc, char **name, char *none, char *two);
+
+int main(int argc, char **argv) {
+    int n;
+    A65CTX ctx = { NULL };
+    CMDOPTS cmd = { NULL };
+
+	printf("6502 Cross-Assembler (Portable)\n");
+	printf("Copyright (c) 1986 William C. Colley, III\n");
+	printf("Copyright (c) 2023-2025 Nathan Misner\n\n");
+
+    ctx.out = stdout;  ctx.err = stderr;
+    options(argc,argv,&ctx,&cmd);
+    if (!ctx.epoch && (ctx.epoch = getenv("SOURCE_DATE_EPOCH")) && !*ctx.epoch)
+		ctx.epoch = NULL;
+    if (!cmd.manifest) ctx.threads = cmd.jobs;
+
+    if (cmd.daemon) { serve();  exit(-1); }
+    if (cmd.manifest) {
+		if (ctx.source) printf("Warning -- %s\n",TWOASM);
+		n = batch(&ctx,cmd.manifest,cmd.jobs);
+    }
+    else if (cmd.watch && ctx.source) { watch(&ctx);  exit(-1); }
+    else if (!ctx.source || !forward(&ctx,&n)) n = a65n_assemble(&ctx);
+    if (n < 0) exit(-1);
+    if (n) printf("%d Error(s)\n",n);
+    else printf("No Errors\n");
+
+    exit(n);
+}
+
+/*  Command line parsing routine.					*/
+
+void options(int argc, char **argv, A65CTX *ctx, CMDOPTS *cmd) {
+    SCRATCH char *s;
+
+    while (--argc > 0) {
+		if (**++argv == '-') {
+			switch (toupper(*++*argv)) {
+			case 'B':	option(&argv,&argc,&ctx -> basedir,NODIR,NULL);  break;
+
+			case 'C':	option(&argv,&argc,&ctx -> cache,NOCACHE,NULL);  break;
+
+			case 'E':	option(&argv,&argc,&ctx -> export,NOEXP,TWOEXP);  break;
+
+			case 'F':	option(&argv,&argc,&ctx -> depfile,NODEP,TWODEP);  break;
+
+			case 'L':	option(&argv,&argc,&ctx -> listing,NOLST,TWOLST);  break;
+
+			case 'O':	option(&argv,&argc,&ctx -> object,NOHEX,TWOHEX);  break;
+
+			case 'P':	ctx -> snapshot = TRUE;  break;
+
+			case 'R':	ctx -> relocate = TRUE;  break;
+
+			case 'S':	ctx -> onepass = TRUE;  break;
+
+			case 'T':	option(&argv,&argc,&ctx -> epoch,NOTIME,NULL);  break;
+
+			case 'M':	if (cmd) option(&argv,&argc,&cmd -> manifest,NOMAN,TWOMAN);
+						else printf("Warning -- %s\n",BADOPT);
+						break;
+
+			case 'J':	s = NULL;
+						if (cmd) option(&argv,&argc,&s,NOJOBS,NULL);
+						else printf("Warning -- %s\n",BADOPT);
+						if (s) cmd -> jobs = atoi(s);
+						break;
+
+			case 'D':	if (cmd) cmd -> daemon = TRUE;
+						else printf("Warning -- %s\n",BADOPT);
+						break;
+
+			case 'W':	if (cmd) cmd -> watch = TRUE;
+						else printf("Warning -- %s\n",BADOPT);
+						break;
+
+			default:	printf("Warning -- %s\n",BADOPT);
+			}
+		}
+		else if (ctx -> source) printf("Warning -- %s\n",TWOASM);
+		else ctx -> source = *argv;
+    }
+    return;
+}
+
+/*  Picks up the file name of an option, either run onto the option	*/
+/*  letter or in the next argument.  A missing name draws the warning	*/
+/*  none, and a second name for the same file the warning two.	*/
+
+static void option(char ***argv, int *argc, char **name, char *none, char *two) {
+    if (!*++**argv) {
+		if (!--*argc) { printf("Warning -- %s\n",none);  return; }
+		else ++*argv;
+    }
+    if (*name && two) printf("Warning -- %s\n",two);
+    else *name = **argv;
+    return;
+}
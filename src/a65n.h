@@ -0,0 +1,92 @@
+#ifndef A65N_H
+#define A65N_H
+
+/*
+			  6502 Cross-Assembler in Portable C
+
+		   Copyright (c) 1986 William C. Colley, III
+
+This header file contains the interface to the assembler library, liba65n.
+A program fills in an assembler context with the source and the files it
+wants, calls a65n_assemble(), and gets the object image and the messages
+back in the context.  Each thread can run an assembly of its own, and the
+source files they read are shared between them.
+*/
+
+#include <stdio.h>
+
+/*  Assembler context.  The fields down to err are filled in by the	*/
+/*  caller; the ones after are filled in by a65n_assemble().  File	*/
+/*  names left NULL mean no such file.  If out or err is NULL, the	*/
+/*  messages that would go to it are kept in diag instead, with a	*/
+/*  fatal error's message starting with the source's name.  With	*/
+/*  atomic set, the listing, object, and export files replace the old	*/
+/*  ones only when the assembly finishes, so a fatal error leaves the	*/
+/*  old ones alone.  With relocate set, the object file (and the	*/
+/*  image) is a relocatable object for the linker, a65n-link.  With	*/
+/*  threads more than 1, pass 2 of a big source is shared out among	*/
+/*  that many threads.							*/
+
+typedef struct {
+    char *source;		/*  main source file name		*/
+    char *text;			/*  its text, or NULL to read the file	*/
+    size_t len;			/*  length of text			*/
+    char *basedir;		/*  prefix for INCL and INCB file names	*/
+    char *listing, *object, *export;
+    char *depfile;		/*  make rule for the files read	*/
+    char *cache;		/*  output cache directory		*/
+    char *epoch;		/*  DATE's time in seconds since 1970	*/
+				/*  (UTC), or NULL for the local time	*/
+    int onepass;		/*  assemble in a single pass		*/
+    int keepimage;		/*  return the object image in image	*/
+    int keepdeps;		/*  return the files read in deps,	*/
+				/*  and those missed in missing		*/
+    int atomic;			/*  replace output files when done	*/
+    int snapshot;		/*  write a snapshot of the symbols	*/
+    int relocate;		/*  write a relocatable object		*/
+    unsigned threads;		/*  threads to run pass 2 on		*/
+    FILE *out;			/*  MSG text, warnings, fatal errors	*/
+    FILE *err;			/*  error lines				*/
+
+    unsigned char *image;	/*  object image (malloc'ed)		*/
+    unsigned long size;		/*  its length				*/
+    char *diag;			/*  kept messages (malloc'ed)		*/
+    size_t diaglen;		/*  their length			*/
+    char *deps;			/*  names of the files read, each	*/
+				/*  ending with \0 (malloc'ed)		*/
+    size_t depslen;		/*  their length			*/
+    char *missing;		/*  names of the files wanted that	*/
+				/*  weren't there, the same way		*/
+    size_t missinglen;		/*  their length			*/
+    unsigned errors;		/*  number of lines with errors		*/
+    char *fatal;		/*  fatal error message, or NULL	*/
+} A65CTX;
+
+
+/*  Assemble the source named in ctx.  Returns the number of lines with	*/
+/*  errors, or -1 if the assembly stopped on a fatal error.		*/
+
+int a65n_assemble(A65CTX *ctx);
+
+
+/*  Free the object image, messages, and file names a65n_assemble()	*/
+/*  left in ctx.							*/
+
+void a65n_release(A65CTX *ctx);
+
+
+/*  Hand the assembler a file in memory.  INCL, INCB, and the main	*/
+/*  source take it under name nam instead of reading the file.  The	*/
+/*  text is copied.  Handing over the same name again replaces it for	*/
+/*  the assemblies that start after.					*/
+
+void a65n_source(char *nam, char *text, size_t len);
+
+
+/*  Forget the source files read or handed over so far.  Files are	*/
+/*  otherwise kept from one assembly to the next, shared by every	*/
+/*  thread, and read again only if they have changed.			*/
+
+void a65n_forget();
+
+#endif
@@ -0,0 +1,288 @@
+/*
+		      6502 Cross-Assembler in Portable C
+
+		   Copyright (c) 1986 William C. Colley, III
+
+This file contains the assembler daemon and its client.  The daemon listens on
+a local socket and runs the assemblies a65n commands send it, one at a time,
+in the directory each command was run from.  Since the daemon lives on between
+assemblies, the source files they read and the assembler's keyword tables are
+ready and waiting for the next one.  The socket is named by the A65N_SOCKET
+environment variable, or is a65n.sock in $XDG_RUNTIME_DIR, or sock in a
+directory /tmp/a65n-UID that only the user can get into.  Each end makes sure
+the other is run by the same user, and hangs up if it isn't.
+
+A request is the command's directory, the source, base directory, listing,
+object, export, and dependency file names, the cache directory, and DATE's
+time (each empty if not given), then the flags ("s" for single-pass, "p" for a
+symbol snapshot, "r" for a relocatable object), then the number of pass 2
+threads, each ending with a \0.  The client then shuts down its side of the
+socket, which it has REQWAIT seconds to do.  The answer is a line giving
+the assembly's result and the lengths of its messages and its error lines,
+then the two texts.
+*/
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+/*  Get global goodies:  */
+
+#include "a65.h"
+#include "a65cmd.h"
+
+#define	REQFIELDS	11		/*  strings in a request	*/
+#define	PATHSIZE	4096		/*  longest string in a request	*/
+#define	REQSIZE		(REQFIELDS * (PATHSIZE + 1))
+#define	REQWAIT		10		/*  seconds to wait on a client	*/
+
+#ifndef _WIN32
+
+/* Static function declarations: */
+static char *sockpath(struct sockaddr_un *addr, int make);
+static int peerok(int fd);
+static void request(int c);
+static char *slurp(int fd, size_t *len, size_t max);
+static int spill(int fd, char *p, size_t n);
+
+void serve() {
+    SCRATCH int fd, c, n;
+    SCRATCH mode_t mask;
+    struct sockaddr_un addr;
+    struct timeval tv;
+
+    signal(SIGPIPE,SIG_IGN);
+    if (!sockpath(&addr,TRUE) || (fd = socket(AF_UNIX,SOCK_STREAM,0)) < 0) {
+		printf("Fatal Error -- %s\n",NOSOCK);  return;
+    }
+    if (!connect(fd,(struct sockaddr *)&addr,sizeof(addr))) {
+		printf("Fatal Error -- %s\n",TWODMN);  close(fd);  return;
+    }
+    unlink(addr.sun_path);
+    mask = umask(077);
+    n = bind(fd,(struct sockaddr *)&addr,sizeof(addr));
+    umask(mask);
+    if (n || chmod(addr.sun_path,0600) || listen(fd,16)) {
+		printf("Fatal Error -- %s\n",NOSOCK);  close(fd);  return;
+    }
+    printf("Listening on %s\n",addr.sun_path);  fflush(stdout);
+
+    tv.tv_sec = REQWAIT;  tv.tv_usec = 0;
+    for (;;) {
+		if ((c = accept(fd,NULL,NULL)) < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			break;
+		}
+		if (peerok(c) && !setsockopt(c,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv)) &&
+			!setsockopt(c,SOL_SOCKET,SO_SNDTIMEO,&tv,sizeof(tv))) request(c);
+		close(c);
+    }
+    printf("Fatal Error -- %s\n",NOSOCK);
+    close(fd);
+    return;
+}
+
+/*  Runs one request from connection c.					*/
+
+static void request(int c) {
+    SCRATCH char *p, *field[REQFIELDS];
+    SCRATCH unsigned i;
+    SCRATCH int n;
+    char *req, *obuf, *ebuf, head[64];
+    size_t len, olen, elen;
+    A65CTX ctx = { NULL };
+
+    if (!(req = slurp(c,&len,REQSIZE))) return;
+    for (p = req, i = 0; i < REQFIELDS && p < req + len; ++i) {
+		field[i] = *p ? p : NULL;
+		p += strlen(p) + 1;
+    }
+    if (i < REQFIELDS || !field[0] || !field[1] || chdir(field[0])) {
+		free(req);  return;
+    }
+    ctx.source = field[1];  ctx.basedir = field[2];
+    ctx.listing = field[3];  ctx.object = field[4];  ctx.export = field[5];
+    ctx.depfile = field[6];  ctx.cache = field[7];  ctx.epoch = field[8];
+    ctx.onepass = field[9] && strchr(field[9],'s');
+    ctx.snapshot = field[9] && strchr(field[9],'p');
+    ctx.relocate = field[9] && strchr(field[9],'r');
+    ctx.threads = field[10] ? (unsigned)strtoul(field[10],NULL,10) : 0;
+    obuf = ebuf = NULL;  olen = elen = 0;
+    ctx.out = open_memstream(&obuf,&olen);
+    ctx.err = open_memstream(&ebuf,&elen);
+    if (ctx.out && ctx.err) {
+		n = a65n_assemble(&ctx);
+		fclose(ctx.out);  fclose(ctx.err);
+		sprintf(head,"%d %lu %lu\n",n,(unsigned long)olen,(unsigned long)elen);
+		if (!spill(c,head,strlen(head)) && !spill(c,obuf,olen)) spill(c,ebuf,elen);
+    }
+    else {
+		if (ctx.out) fclose(ctx.out);
+		if (ctx.err) fclose(ctx.err);
+    }
+    a65n_release(&ctx);
+    free(obuf);  free(ebuf);  free(req);
+    return;
+}
+
+int forward(A65CTX *ctx, int *result) {
+    SCRATCH int fd;
+    SCRATCH char *p;
+    SCRATCH unsigned long olen, elen;
+    char *req, *ans, *field[REQFIELDS], flags[4], jobs[24];
+    size_t len;
+    unsigned i;
+    struct sockaddr_un addr;
+
+    if (!sockpath(&addr,FALSE) || (fd = socket(AF_UNIX,SOCK_STREAM,0)) < 0)
+		return FALSE;
+    if (connect(fd,(struct sockaddr *)&addr,sizeof(addr)) || !peerok(fd)) {
+		close(fd);  return FALSE;
+    }
+    signal(SIGPIPE,SIG_IGN);
+
+    if (!(req = (char *)malloc(REQSIZE)) || !getcwd(req,PATHSIZE)) {
+		free(req);  close(fd);  return FALSE;
+    }
+    field[0] = req;  field[1] = ctx -> source;  field[2] = ctx -> basedir;
+    field[3] = ctx -> listing;  field[4] = ctx -> object;  field[5] = ctx -> export;
+    field[6] = ctx -> depfile;  field[7] = ctx -> cache;  field[8] = ctx -> epoch;
+    field[9] = p = flags;
+    if (ctx -> onepass) *p++ = 's';
+    if (ctx -> snapshot) *p++ = 'p';
+    if (ctx -> relocate) *p++ = 'r';
+    *p = '\0';
+    sprintf(jobs,"%u",ctx -> threads);
+    field[10] = ctx -> threads ? jobs : NULL;
+    for (p = req + strlen(req) + 1, i = 1; i < REQFIELDS; ++i) {
+		len = field[i] ? strlen(field[i]) : 0;
+		if (len > PATHSIZE) { free(req);  close(fd);  return FALSE; }
+		if (len) memcpy(p,field[i],len);
+		p += len;  *p++ = '\0';
+    }
+    if (spill(fd,req,p - req) || shutdown(fd,SHUT_WR)) {
+		free(req);  close(fd);  return FALSE;
+    }
+    free(req);
+
+    ans = slurp(fd,&len,(size_t)-1);
+    close(fd);
+    if (!ans || sscanf(ans,"%d %lu %lu",result,&olen,&elen) != 3 ||
+		!(p = memchr(ans,'\n',len)) || len - (++p - ans) != olen + elen) {
+		free(ans);  return FALSE;
+    }
+    fwrite(p,1,olen,stdout);  fflush(stdout);
+    fwrite(p + olen,1,elen,stderr);
+    free(ans);
+    return TRUE;
+}
+
+/*  Fills in the address of the daemon's socket.  If make is set, the	*/
+/*  directory /tmp/a65n-UID is made if it's wanted.  Returns NULL if	*/
+/*  the name is too long, or if that directory isn't the user's alone.	*/
+
+static char *sockpath(struct sockaddr_un *addr, int make) {
+    SCRATCH char *p;
+    SCRATCH size_t n;
+    struct stat st;
+
+    memset(addr,0,sizeof(*addr));
+    addr -> sun_family = AF_UNIX;  n = sizeof(addr -> sun_path);
+    if ((p = getenv("A65N_SOCKET")) && *p)
+		return snprintf(addr -> sun_path,n,"%s",p) < (int)n ? addr -> sun_path : NULL;
+    if ((p = getenv("XDG_RUNTIME_DIR")) && *p)
+		return snprintf(addr -> sun_path,n,"%s/a65n.sock",p) < (int)n ?
+			addr -> sun_path : NULL;
+    snprintf(addr -> sun_path,n,"/tmp/a65n-%u",(unsigned)getuid());
+    if (make) mkdir(addr -> sun_path,0700);
+    if (lstat(addr -> sun_path,&st) || !S_ISDIR(st.st_mode) ||
+		st.st_uid != getuid() || (st.st_mode & 077)) return NULL;
+    strcat(addr -> sun_path,"/sock");
+    return addr -> sun_path;
+}
+
+/*  Tells whether the process at the other end of connection fd is run	*/
+/*  by this user.							*/
+
+static int peerok(int fd) {
+#ifdef SO_PEERCRED
+    struct ucred cr;
+    socklen_t n = sizeof(cr);
+
+    return !getsockopt(fd,SOL_SOCKET,SO_PEERCRED,&cr,&n) && cr.uid == getuid();
+#else
+    uid_t u;
+    gid_t g;
+
+    return !getpeereid(fd,&u,&g) && u == getuid();
+#endif
+}
+
+/*  Reads fd to its end, up to max bytes.  Returns the text, with a \0	*/
+/*  after it, and its length in *len, or NULL if it can't be read.	*/
+
+static char *slurp(int fd, size_t *len, size_t max) {
+    SCRATCH char *p, *q;
+    SCRATCH size_t size;
+    SCRATCH ssize_t n;
+
+    p = NULL;  *len = size = 0;
+    for (;;) {
+		if (*len + 1 >= size) {
+			size = size ? size * 2 : 4096;
+			if (!(q = (char *)realloc(p,size))) { free(p);  return NULL; }
+			p = q;
+		}
+		if ((n = read(fd,p + *len,size - *len - 1)) > 0) {
+			if ((*len += n) > max) { free(p);  return NULL; }
+		}
+		else if (!n) break;
+		else if (errno != EINTR) { free(p);  return NULL; }
+    }
+    p[*len] = '\0';
+    return p;
+}
+
+/*  Writes n bytes from p to fd.  Returns non-zero if they can't be	*/
+/*  written.								*/
+
+static int spill(int fd, char *p, size_t n) {
+    SCRATCH ssize_t k;
+
+    while (n) {
+		if ((k = write(fd,p,n)) > 0) { p += k;  n -= k; }
+		else if (k < 0 && errno == EINTR) continue;
+		else return -1;
+    }
+    return 0;
+}
+
+#else
+
+/*  There are no local sockets to be had, so there is no daemon.	*/
+
+void serve() {
+    printf("Fatal Error -- %s\n",NOSOCK);
+    return;
+}
+
+int forward(A65CTX *ctx, int *result) {
+    return FALSE;
+}
+
+#endif
@@ -7,164 +7,663 @@ This module contains the following utility packages:
 
 	1)  symbol table building and searching
 
-	2)  opcode and operator table searching
+	2)  dead code elimination
 
-	3)  listing file output
+	3)  opcode and operator table searching
 
-	4)  hex file output
+	4)  listing file output
 
-	5)  error flagging
+	5)  hex file output
+
+	6)  relocatable object output
+
+	7)  source file caching
+
+	8)  output caching
+
+	9)  error flagging
 */
 
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700
+#endif
+
 #include <ctype.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define	getpid		_getpid
+#define	mkdir(d,m)	_mkdir(d)
+#define	realpath(n,r)	_fullpath(r,n,0)
+#else
+#include <unistd.h>
+#endif
+#ifndef __STDC_NO_THREADS__
+#include <threads.h>
+#endif
 
 /*  Get global goodies:  */
 
 #include "a65.h"
 #include "a65eval.h"
 #include "a65util.h"
+#include "a65n.h"
 
 /*  Get access to global mailboxes defined in A65.C:			*/
 
-extern char errcode, line[], title[];
-extern int eject, filesp, listhex, pass;
-extern unsigned address, bytes, errors, listleft, obj[], pagelen;
-extern FILE_INFO filestk[];
-
-/*  The symbol table is a binary tree of variable-length blocks drawn	*/
-/*  from the heap with the calloc() function.  The root pointer lives	*/
-/*  here:								*/
-
-static SYMBOL *sroot = NULL;
+extern THREAD char basedir[], errcode, line[], title[];
+extern THREAD int eject, filesp, lastpass, listhex, onepass, pass, relocate, worker;
+extern THREAD unsigned address, bytes, errors, inproc, listleft, obj[], pagelen;
+extern THREAD FILE_INFO filestk[];
+extern THREAD A65CTX *ctx;
+extern THREAD jmp_buf *bailout;
+
+/*  The symbol table is a hash table of slots that grows (keeping it	*/
+/*  at most half full) as names are added.  Each global label's slot	*/
+/*  can own a scope, a smaller table of the same kind that holds its	*/
+/*  local labels under their own names.  The names and symbols are	*/
+/*  carved out of large blocks of memory that are never given back.	*/
+
+static THREAD SCOPE globals = { 0, 0, NULL };
+static THREAD SCOPE *curscope = NULL;
+static THREAD char *curglob = NULL, splitbuf[MAXLINE * 2 + 1];
+static THREAD int curdot = FALSE;
+static THREAD unsigned nsyms = 0;
+static THREAD char *arenap = NULL;
+static THREAD size_t arenaleft = 0;
+static THREAD void *arenas = NULL;
 
 /* Static function declarations: */
-static OPCODE *bsearchtbl(OPCODE *lo, OPCODE *hi, char *nam);
-static int ustrcmp(char *s, char *t);
-static void list_sym(SYMBOL *sp);
-static void check_page();
+static SYMSLOT *lookup(SCOPE *sc, char *glob, char *nam, int add);
+static SYMSLOT *place(char *glob, char *nam, int add, char **pre);
+static SCOPE *scope(char *glob, int add);
+static void grow_scope(SCOPE *sc);
+static void unset(SCOPE *sc);
+static int refcmp(const void *a, const void *b);
+static unsigned long long pack(char *nam);
+static KEYWORD *keyword(char *nam);
+static void build_keywords();
+static FILE *create(char *nam, char *mode, char **tmp, int atomic);
+static int commit(FILE *fp, char *nam, char **tmp);
+static void scrap(FILE *fp, char **tmp);
+static void dname(FILE *fp, char *nam);
+static void sput4(FILE *fp, unsigned long n);
+static void hear(char *fmt, va_list ap);
+static char *cload(char *id, char *ext, size_t *len);
+static int csave(char *id, char *ext, char *p, size_t n);
+static int ccopy(char *nam, char *ext);
+static int cput(char *nam, char *p, size_t n);
+static void hexhash(char *s, unsigned char *sum);
+static void hinit(HASH *h);
+static void hadd(HASH *h, const void *p, size_t n);
+static void hdone(HASH *h, unsigned char *sum);
+static void hblock(HASH *h);
+static int symcmp(const void *a, const void *b);
+static unsigned gather(SCOPE *sc, SYMBOL **v);
+static void free_scope(SCOPE *sc);
+static void list_sym();
+static void list_line();
+static void lpage(LISTROW *r);
+static int check_page();
+static LISTROW *lslot();
+static void lpush();
+static char *lroom(LWRITER *w);
+static void lflush(LWRITER *w);
+static void lstop();
+static char *lrow(char *p, LISTROW *r);
+static char *lhex(char *p, unsigned u, int width);
+#ifdef LWRITER_THREAD
+static int lwrite(void *arg);
+#endif
 static void record();
+static unsigned rfind(char *nam, int ext);
+static void rclear();
+static void rbuild();
+static void rword(unsigned long u);
+static SRCFILE *sfind(char *nam, char *path, int binary);
+static SRCFILE *snew(char *nam, char *path, int binary);
+static void smissed(char *nam);
+static char *sread(SRCFILE *sf, FILE *fp);
+static SRCFILE *sadd(SRCFILE *nf);
+static int sbusied(char *path, int binary);
+static void sdrop(SRCFILE *sf);
+static void shash(SRCFILE *sf, unsigned char *sum);
 
 /*  Add new symbol to symbol table.  Returns pointer to symbol even if	*/
 /*  the symbol already exists.  If there's not enough memory to store	*/
 /*  the new symbol, a fatal error occurs.				*/
 
 SYMBOL *new_symbol(char *nam) {
-    SCRATCH int i;
-    SCRATCH SYMBOL **p, *q;
-
-    for (p = &sroot; (q = *p) && (i = strcmp(nam,q -> sname)); )
-		p = i < 0 ? &(q -> left) : &(q -> right);
-    if (!q) {
-		if (!(*p = q = (SYMBOL *)calloc(1,sizeof(SYMBOL) + strlen(nam))))
-			fatal_error(SYMBOLS);
-		strcpy(q -> sname,nam);
-    }
-    return q;
+    return new_local("",nam);
 }
 
 /*  Look up symbol in symbol table.  Returns pointer to symbol or NULL	*/
-/*  if symbol not found.						*/
+/*  if symbol not found.  Symbols that new_symbol() made for the token	*/
+/*  cache but that were never defined are not found.			*/
 
 SYMBOL *find_symbol(char *nam) {
-    SCRATCH int i;
-    SCRATCH SYMBOL *p;
+    return find_local("",nam);
+}
+
+/*  Same as new_symbol() and find_symbol(), but for the local label	*/
+/*  nam in the scope of the global label glob, which must be an		*/
+/*  interned string.  The symbol's full name is glob followed by nam.	*/
+
+SYMBOL *new_local(char *glob, char *nam) {
+    SCRATCH SYMSLOT *p;
+
+    if (!(p = place(glob,nam,!worker,&glob)) || !p -> sym) {
+		if (worker) handback();
+		p -> sym = (SYMBOL *)arena(sizeof(SYMBOL));
+		p -> sym -> sname = p -> name - strlen(glob);  ++nsyms;
+    }
+    return p -> sym;
+}
+
+SYMBOL *find_local(char *glob, char *nam) {
+    SCRATCH SYMSLOT *p;
+
+    return (p = place(glob,nam,FALSE,&glob)) && p -> sym &&
+		p -> sym -> attr ? p -> sym : NULL;
+}
+
+/*  String interning routine.  Returns the one stored copy of the	*/
+/*  string, adding it to the table if need be.				*/
+
+char *intern(char *nam) {
+    SCRATCH SYMSLOT *p;
+
+    if (!(p = lookup(&globals,"",nam,!worker))) handback();
+    return p -> name;
+}
 
-    for (p = sroot; p && (i = strcmp(nam,p -> sname));
-		p = i < 0 ? p -> left : p -> right);
+/*  Memory arena allocation routine.  Returns n bytes of zeroed memory	*/
+/*  that lasts until the end of the assembly.  If there's not enough	*/
+/*  memory, a fatal error occurs.  Each block starts with a pointer to	*/
+/*  the one before it, so endutil() can give them all back.		*/
+
+void *arena(size_t n) {
+    SCRATCH char *p;
+
+    n = (n + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    if (n > arenaleft) {
+		if (n > ARENASIZE / 4) {
+			if (!(p = (char *)calloc(1,n + sizeof(void *)))) fatal_error(MEMFULL);
+			*(void **)p = arenas;  arenas = p;
+			return p + sizeof(void *);
+		}
+		if (!(arenap = (char *)calloc(1,ARENASIZE))) fatal_error(MEMFULL);
+		*(void **)arenap = arenas;  arenas = arenap;
+		arenap += sizeof(void *);  arenaleft = ARENASIZE - sizeof(void *);
+    }
+    p = arenap;  arenap += n;  arenaleft -= n;
     return p;
 }
 
+/*  Finds the slot for nam in the table sc.  If the name isn't there,	*/
+/*  it's added if add is set, otherwise NULL is returned.  A new name	*/
+/*  is stored after glob so that the symbol's full name comes along	*/
+/*  for free.  Names are hashed with FNV-1a.				*/
+
+static SYMSLOT *lookup(SCOPE *sc, char *glob, char *nam, int add) {
+    SCRATCH unsigned h, i;
+    SCRATCH char *q;
+    SCRATCH SYMSLOT *p;
+
+    if (add && 2 * (sc -> count + 1) > sc -> size) grow_scope(sc);
+    if (!sc -> size) return NULL;
+    for (h = 2166136261u, q = nam; *q; ++q) h = (h ^ (*q & 0377)) * 16777619u;
+    for (i = h & (sc -> size - 1); (p = sc -> slot + i) -> name;
+		i = (i + 1) & (sc -> size - 1))
+		if (p -> hash == h && !strcmp(p -> name,nam)) return p;
+    if (!add) return NULL;
+    q = (char *)arena(strlen(glob) + strlen(nam) + 1);
+    p -> name = strcpy(q + strlen(strcpy(q,glob)),nam);
+    p -> hash = h;  ++sc -> count;
+    return p;
+}
+
+/*  Finds the slot for the symbol whose full name is glob followed by	*/
+/*  nam, and passes back through pre the global label it was filed	*/
+/*  under.  A name with a dot past its first character is filed as a	*/
+/*  local label of the part before the dot, however it was written, so	*/
+/*  that Reset.loop and .loop after Reset are the same symbol.		*/
+
+static SYMSLOT *place(char *glob, char *nam, int add, char **pre) {
+    SCRATCH char *q;
+    SCRATCH SCOPE *sc;
+    SCRATCH SYMSLOT *p;
+
+    if (*glob) {
+		sc = scope(glob,add);
+		if (!curdot) { *pre = glob;  return sc ? lookup(sc,glob,nam,add) : NULL; }
+		nam = strcat(strcpy(splitbuf,glob),nam);
+    }
+    *pre = "";
+    if (!*nam || !(q = strchr(nam + 1,'.'))) return lookup(&globals,"",nam,add);
+    if (nam != splitbuf) { q = splitbuf + (q - nam);  nam = strcpy(splitbuf,nam); }
+    *q = '\0';  p = lookup(&globals,"",nam,add);  *q = '.';
+    if (!p || !(sc = scope(p -> name,add))) return NULL;
+    *pre = p -> name;
+    return lookup(sc,p -> name,q,add);
+}
+
+/*  Returns the scope of the global label glob, making it if add is	*/
+/*  set.  Runs of local labels are all in the same scope, so the last	*/
+/*  one found is remembered.  A global label with a dot past its first	*/
+/*  character has no scope of its own, and sets curdot instead.		*/
+
+static SCOPE *scope(char *glob, int add) {
+    SCRATCH SYMSLOT *p;
+
+    if (glob != curglob || (!curscope && !curdot && add)) {
+		curglob = glob;  curscope = NULL;
+		if (!(curdot = strchr(glob + 1,'.') != NULL) &&
+			(p = lookup(&globals,"",glob,add))) {
+			if (!p -> scope && add) p -> scope = (SCOPE *)arena(sizeof(SCOPE));
+			curscope = p -> scope;
+		}
+    }
+    return curscope;
+}
+
+static void grow_scope(SCOPE *sc) {
+    SCRATCH unsigned i, j, n;
+    SCRATCH SYMSLOT *t;
+
+    n = sc -> size ? sc -> size * 2 : sc == &globals ? SYMSIZE : SCOPESIZE;
+    if (!(t = (SYMSLOT *)calloc(n,sizeof(SYMSLOT)))) fatal_error(SYMBOLS);
+    for (i = 0; i < sc -> size; ++i) {
+		if (sc -> slot[i].name) {
+			for (j = sc -> slot[i].hash & (n - 1); t[j].name; j = (j + 1) & (n - 1));
+			t[j] = sc -> slot[i];
+		}
+    }
+    free(sc -> slot);
+    sc -> slot = t;  sc -> size = n;
+    return;
+}
+
+/*  Dead code elimination.  Pass 1 records every reference it finds	*/
+/*  in prefs.  prune() then follows them from the code outside the	*/
+/*  PROC blocks, through each block reached to the blocks it refers	*/
+/*  to, and marks the blocks it gets to in plive.  pdone is set once	*/
+/*  it has, after which nothing more is recorded.			*/
+
+static THREAD PROCREF *prefs = NULL;
+static THREAD unsigned long nprefs = 0, prefsize = 0;
+static THREAD unsigned nprocs = 0;
+static THREAD char *plive = NULL;
+static THREAD int pdone = FALSE;
+
+unsigned pnew() {
+    if (pdone) return 0;
+    if (nprocs == NOPROC - 1) fatal_error(SYMBOLS);
+    return ++nprocs;
+}
+
+void refer(SYMBOL *sym) {
+    SCRATCH PROCREF *r;
+
+    if (pdone || onepass || inproc == NOPROC) return;
+    if (nprefs && prefs[nprefs - 1].from == inproc && prefs[nprefs - 1].to == sym) return;
+    if (nprefs == prefsize) {
+		prefsize = prefsize ? prefsize * 2 : 1024;
+		if (!(prefs = (PROCREF *)realloc(prefs,prefsize * sizeof(PROCREF))))
+			fatal_error(MEMFULL);
+    }
+    r = prefs + nprefs++;
+    r -> from = inproc;  r -> to = sym;
+    return;
+}
+
+int prune() {
+    SCRATCH unsigned long i, *first;
+    SCRATCH unsigned n, t, sp, *stack;
+
+    if (pdone) return FALSE;
+    pdone = TRUE;
+    if (!nprocs) return FALSE;
+    if (!(plive = (char *)calloc(nprocs + 1,1)) ||
+		!(first = (unsigned long *)malloc((nprocs + 2) * sizeof(unsigned long))) ||
+		!(stack = (unsigned *)malloc((nprocs + 1) * sizeof(unsigned)))) fatal_error(MEMFULL);
+    if (nprefs) qsort(prefs,nprefs,sizeof(PROCREF),refcmp);
+    for (n = i = 0; n <= nprocs; ++n) {
+		first[n] = i;
+		while (i < nprefs && prefs[i].from == n) ++i;
+    }
+    first[n] = i;
+
+    plive[0] = TRUE;  stack[0] = 0;  sp = 1;
+    while (sp) {
+		n = stack[--sp];
+		for (i = first[n]; i < first[n + 1]; ++i) {
+			t = prefs[i].to -> proc;
+			if (t && t <= nprocs && !plive[t]) { plive[t] = TRUE;  stack[sp++] = t; }
+		}
+    }
+    free(first);  free(stack);
+    free(prefs);  prefs = NULL;  nprefs = prefsize = 0;
+    for (n = 1; n <= nprocs && plive[n]; ++n);
+    return n <= nprocs;
+}
+
+int live(unsigned n) {
+    return !plive || !n || n > nprocs || plive[n];
+}
+
+int dropped(SYMBOL *sym) {
+    return !live(sym -> proc);
+}
+
+void forget() {
+    unset(&globals);
+    rclear();
+    return;
+}
+
+/*  Symbol table lending routines.  symlend() hands over the symbol	*/
+/*  table and PROC blocks, and symborrow() lets a pass 2 worker thread	*/
+/*  look labels up in them.  The worker never adds to them, and never	*/
+/*  gives them back.							*/
+
+void symlend(SYMTAB *t) {
+    t -> globals = globals;  t -> plive = plive;  t -> nprocs = nprocs;
+    return;
+}
+
+void symborrow(SYMTAB *t) {
+    globals = t -> globals;  plive = t -> plive;  nprocs = t -> nprocs;
+    pdone = TRUE;  curscope = NULL;  curglob = NULL;  curdot = FALSE;
+    return;
+}
+
+/*  Forgets the values of the labels in table sc and its scopes.  It	*/
+/*  recurses, so no SCRATCH here.					*/
+
+static void unset(SCOPE *sc) {
+    unsigned i;
+    SYMBOL *l;
+
+    for (i = 0; i < sc -> size; ++i) {
+		if ((l = sc -> slot[i].sym)) { l -> attr = l -> valu = l -> rel = 0;  l -> wait = NULL; }
+		if (sc -> slot[i].scope) unset(sc -> slot[i].scope);
+    }
+    return;
+}
+
+static int refcmp(const void *a, const void *b) {
+    SCRATCH unsigned x, y;
+
+    x = ((PROCREF *)a) -> from;  y = ((PROCREF *)b) -> from;
+    return x < y ? -1 : x > y;
+}
+
+/*  Pseudo-op table.							*/
+
+static OPCODE opctbl[] = {
+	{ PSEUDO,			ALIGN,	"ALIGN"	},
+	{ PSEUDO,			BASE,	"BASE"	},
+	{ PSEUDO,			DATE,	"DATE"	},
+	{ PSEUDO,			DB,		"DB"	},
+	{ PSEUDO,			DW,		"DW"	},
+	{ PSEUDO + ISIF,	ELSE,	"ELSE"	},
+	{ PSEUDO,			END,	"END"	},
+	{ PSEUDO + ISIF,	ENDI,	"ENDI"	},
+	{ PSEUDO,			ENDPROC,"ENDPROC"	},
+	{ PSEUDO,			EQU,	"EQU"	},
+	{ PSEUDO,			EXP,	"EXP"	},
+	{ PSEUDO,			EXTRN,	"EXTRN"	},
+	{ PSEUDO + ISIF,	IF,		"IF"	},
+	{ PSEUDO,			INCB,	"INCB"	},
+	{ PSEUDO,			INCL,	"INCL"	},
+	{ PSEUDO,			KEEP,	"KEEP"	},
+	{ PSEUDO,			MSG,	"MSG"	},
+	{ PSEUDO,			ORG,	"ORG"	},
+	{ PSEUDO,			PAGE,	"PAGE"	},
+	{ PSEUDO,			PROC,	"PROC"	},
+	{ PSEUDO,			RMB,	"RMB"	},
+	{ PSEUDO,			SECT,	"SECT"	},
+	{ PSEUDO,			SET,	"SET"	},
+	{ PSEUDO,			TITL,	"TITL"	}
+};
+
+/*  Machine opcode encoding table.  The addressing modes run across in	*/
+/*  the order IMP, ACC, IMM, ZP, ZP,X, ZP,Y, ABS, ABS,X, ABS,Y, (IND),	*/
+/*  (IND,X), (IND),Y, and REL.  The cycle counts don't include the	*/
+/*  extra cycles for crossing a page or taking a branch.		*/
+
+static ENCODING enctbl[] = {
+	{ { 0, 0, "ADC" },
+		{    0,    0, 0x69, 0x65, 0x75,    0, 0x6d, 0x7d, 0x79,    0, 0x61, 0x71,    0 },
+		{    0,    0,    2,    3,    4,    0,    4,    4,    4,    0,    6,    5,    0 } },
+	{ { 0, 0, "AND" },
+		{    0,    0, 0x29, 0x25, 0x35,    0, 0x2d, 0x3d, 0x39,    0, 0x21, 0x31,    0 },
+		{    0,    0,    2,    3,    4,    0,    4,    4,    4,    0,    6,    5,    0 } },
+	{ { 0, 0, "ASL" },
+		{    0, 0x0a,    0, 0x06, 0x16,    0, 0x0e, 0x1e,    0,    0,    0,    0,    0 },
+		{    0,    2,    0,    5,    6,    0,    6,    7,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "ASLA" },
+		{ 0x0a,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "BCC" },
+		{    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0, 0x90 },
+		{    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    2 } },
+	{ { 0, 0, "BCS" },
+		{    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0, 0xb0 },
+		{    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    2 } },
+	{ { 0, 0, "BEQ" },
+		{    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0, 0xf0 },
+		{    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    2 } },
+	{ { 0, 0, "BIT" },
+		{    0,    0,    0, 0x24,    0,    0, 0x2c,    0,    0,    0,    0,    0,    0 },
+		{    0,    0,    0,    3,    0,    0,    4,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "BMI" },
+		{    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0, 0x30 },
+		{    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    2 } },
+	{ { 0, 0, "BNE" },
+		{    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0, 0xd0 },
+		{    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    2 } },
+	{ { 0, 0, "BPL" },
+		{    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0, 0x10 },
+		{    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    2 } },
+	{ { 0, 0, "BRK" },
+		{ 0x00,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    7,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "BVC" },
+		{    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0, 0x50 },
+		{    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    2 } },
+	{ { 0, 0, "BVS" },
+		{    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0, 0x70 },
+		{    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    2 } },
+	{ { 0, 0, "CLC" },
+		{ 0x18,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "CLD" },
+		{ 0xd8,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "CLI" },
+		{ 0x58,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "CLV" },
+		{ 0xb8,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "CMP" },
+		{    0,    0, 0xc9, 0xc5, 0xd5,    0, 0xcd, 0xdd, 0xd9,    0, 0xc1, 0xd1,    0 },
+		{    0,    0,    2,    3,    4,    0,    4,    4,    4,    0,    6,    5,    0 } },
+	{ { 0, 0, "CPX" },
+		{    0,    0, 0xe0, 0xe4,    0,    0, 0xec,    0,    0,    0,    0,    0,    0 },
+		{    0,    0,    2,    3,    0,    0,    4,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "CPY" },
+		{    0,    0, 0xc0, 0xc4,    0,    0, 0xcc,    0,    0,    0,    0,    0,    0 },
+		{    0,    0,    2,    3,    0,    0,    4,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "DEC" },
+		{    0,    0,    0, 0xc6, 0xd6,    0, 0xce, 0xde,    0,    0,    0,    0,    0 },
+		{    0,    0,    0,    5,    6,    0,    6,    7,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "DEX" },
+		{ 0xca,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "DEY" },
+		{ 0x88,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "EOR" },
+		{    0,    0, 0x49, 0x45, 0x55,    0, 0x4d, 0x5d, 0x59,    0, 0x41, 0x51,    0 },
+		{    0,    0,    2,    3,    4,    0,    4,    4,    4,    0,    6,    5,    0 } },
+	{ { 0, 0, "INC" },
+		{    0,    0,    0, 0xe6, 0xf6,    0, 0xee, 0xfe,    0,    0,    0,    0,    0 },
+		{    0,    0,    0,    5,    6,    0,    6,    7,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "INX" },
+		{ 0xe8,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "INY" },
+		{ 0xc8,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "JMP" },
+		{    0,    0,    0,    0,    0,    0, 0x4c,    0,    0, 0x6c,    0,    0,    0 },
+		{    0,    0,    0,    0,    0,    0,    3,    0,    0,    5,    0,    0,    0 } },
+	{ { 0, 0, "JSR" },
+		{    0,    0,    0,    0,    0,    0, 0x20,    0,    0,    0,    0,    0,    0 },
+		{    0,    0,    0,    0,    0,    0,    6,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "LDA" },
+		{    0,    0, 0xa9, 0xa5, 0xb5,    0, 0xad, 0xbd, 0xb9,    0, 0xa1, 0xb1,    0 },
+		{    0,    0,    2,    3,    4,    0,    4,    4,    4,    0,    6,    5,    0 } },
+	{ { 0, 0, "LDX" },
+		{    0,    0, 0xa2, 0xa6,    0, 0xb6, 0xae,    0, 0xbe,    0,    0,    0,    0 },
+		{    0,    0,    2,    3,    0,    4,    4,    0,    4,    0,    0,    0,    0 } },
+	{ { 0, 0, "LDY" },
+		{    0,    0, 0xa0, 0xa4, 0xb4,    0, 0xac, 0xbc,    0,    0,    0,    0,    0 },
+		{    0,    0,    2,    3,    4,    0,    4,    4,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "LSR" },
+		{    0, 0x4a,    0, 0x46, 0x56,    0, 0x4e, 0x5e,    0,    0,    0,    0,    0 },
+		{    0,    2,    0,    5,    6,    0,    6,    7,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "LSRA" },
+		{ 0x4a,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "NOP" },
+		{ 0xea,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "ORA" },
+		{    0,    0, 0x09, 0x05, 0x15,    0, 0x0d, 0x1d, 0x19,    0, 0x01, 0x11,    0 },
+		{    0,    0,    2,    3,    4,    0,    4,    4,    4,    0,    6,    5,    0 } },
+	{ { 0, 0, "PHA" },
+		{ 0x48,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    3,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "PHP" },
+		{ 0x08,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    3,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "PLA" },
+		{ 0x68,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    4,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "PLP" },
+		{ 0x28,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    4,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "ROL" },
+		{    0, 0x2a,    0, 0x26, 0x36,    0, 0x2e, 0x3e,    0,    0,    0,    0,    0 },
+		{    0,    2,    0,    5,    6,    0,    6,    7,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "ROLA" },
+		{ 0x2a,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "ROR" },
+		{    0, 0x6a,    0, 0x66, 0x76,    0, 0x6e, 0x7e,    0,    0,    0,    0,    0 },
+		{    0,    2,    0,    5,    6,    0,    6,    7,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "RORA" },
+		{ 0x6a,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "RTI" },
+		{ 0x40,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    6,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "RTS" },
+		{ 0x60,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    6,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "SBC" },
+		{    0,    0, 0xe9, 0xe5, 0xf5,    0, 0xed, 0xfd, 0xf9,    0, 0xe1, 0xf1,    0 },
+		{    0,    0,    2,    3,    4,    0,    4,    4,    4,    0,    6,    5,    0 } },
+	{ { 0, 0, "SEC" },
+		{ 0x38,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "SED" },
+		{ 0xf8,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "SEI" },
+		{ 0x78,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "STA" },
+		{    0,    0,    0, 0x85, 0x95,    0, 0x8d, 0x9d, 0x99,    0, 0x81, 0x91,    0 },
+		{    0,    0,    0,    3,    4,    0,    4,    5,    5,    0,    6,    6,    0 } },
+	{ { 0, 0, "STX" },
+		{    0,    0,    0, 0x86,    0, 0x96, 0x8e,    0,    0,    0,    0,    0,    0 },
+		{    0,    0,    0,    3,    0,    4,    4,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "STY" },
+		{    0,    0,    0, 0x84, 0x94,    0, 0x8c,    0,    0,    0,    0,    0,    0 },
+		{    0,    0,    0,    3,    4,    0,    4,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "TAX" },
+		{ 0xaa,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "TAY" },
+		{ 0xa8,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "TSX" },
+		{ 0xba,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "TXA" },
+		{ 0x8a,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "TXS" },
+		{ 0x9a,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } },
+	{ { 0, 0, "TYA" },
+		{ 0x98,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 },
+		{    2,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0 } }
+};
+
+static OPCODE oprtbl[] = {
+	{ REG,						'A',		"A"		},
+	{ BINARY + LOG1  + OPR,		AND,		"AND"	},
+	{ BINARY + RELAT + OPR,		'=',		"EQ"	},
+	{ BINARY + RELAT + OPR,		GE,			"GE"	},
+	{ BINARY + RELAT + OPR,		'>',		"GT"	},
+	{ UNARY  + UOP3  + OPR,		HIGH,		"HIGH"	},
+	{ BINARY + RELAT + OPR,		LE,			"LE"	},
+	{ UNARY  + UOP3  + OPR,		LOW,		"LOW"	},
+	{ BINARY + RELAT + OPR,		'<',		"LT"	},
+	{ BINARY + MULT  + OPR,		MOD,		"MOD"	},
+	{ BINARY + RELAT + OPR,		NE,			"NE"	},
+	{ UNARY  + UOP2  + OPR,		NOT,		"NOT"	},
+	{ BINARY + LOG2  + OPR,		OR,			"OR"	},
+	{ BINARY + MULT  + OPR,		SHL,		"SHL"	},
+	{ BINARY + MULT  + OPR,		SHR,		"SHR"	},
+	{ REG,						'X',		"X"		},
+	{ BINARY + LOG2  + OPR,		XOR,		"XOR"	},
+	{ REG,						'Y',		"Y"		}
+};
+
+/*  Keyword hash table.  kwslot[] maps the top KEYBITS bits of the	*/
+/*  packed name times kwmult to one more than the name's index in	*/
+/*  kwtbl[], or to 0 if no keyword hashes there.  kwmult is picked	*/
+/*  the first time through so that no two keywords collide.		*/
+
+static THREAD KEYWORD kwtbl[sizeof(opctbl) / sizeof(OPCODE) +
+	sizeof(enctbl) / sizeof(ENCODING) + sizeof(oprtbl) / sizeof(OPCODE)];
+static THREAD unsigned char kwslot[1 << KEYBITS];
+static THREAD unsigned long long kwmult = 0;
+
 /*  Opcode table search routine.  This routine pats down the opcode	*/
 /*  table for a given opcode and returns either a pointer to it or	*/
-/*  NULL if the opcode doesn't exist.					*/
+/*  NULL if the opcode doesn't exist.  A machine opcode's entry is the	*/
+/*  head of its ENCODING.						*/
 
 OPCODE *find_code(char *nam) {
-	static OPCODE opctbl[] = {
-		{ TWOOP,			0x61,	"ADC"	},
-		{ PSEUDO,			ALIGN,	"ALIGN"	},
-		{ TWOOP,			0x21,	"AND"	},
-		{ LOGOP,			0x06,	"ASL"	},
-		{ INHOP,			0x0a,	"ASLA"	},
-		{ PSEUDO,			BASE,	"BASE"	},
-		{ RELBR,			0x90,	"BCC"	},
-		{ RELBR,			0xb0,	"BCS"	},
-		{ RELBR,			0xf0,	"BEQ"	},
-		{ BITOP,			0x24,	"BIT"	},
-		{ RELBR,			0x30,	"BMI"	},
-		{ RELBR,			0xd0,	"BNE"	},
-		{ RELBR,			0x10,	"BPL"	},
-		{ INHOP,			0x00,	"BRK"	},
-		{ RELBR,			0x50,	"BVC"	},
-		{ RELBR,			0x70,	"BVS"	},
-		{ INHOP,			0x18,	"CLC"	},
-		{ INHOP,			0xd8,	"CLD"	},
-		{ INHOP,			0x58,	"CLI"	},
-		{ INHOP,			0xb8,	"CLV"	},
-		{ TWOOP,			0xc1,	"CMP"	},
-		{ CPXY,				0xe0,	"CPX"	},
-		{ CPXY,				0xc0,	"CPY"	},
-		{ PSEUDO,			DATE,	"DATE"	},
-		{ PSEUDO,			DB,		"DB"	},
-		{ INCOP,			0xc6,	"DEC"	},
-		{ INHOP,			0xca,	"DEX"	},
-		{ INHOP,			0x88,	"DEY"	},
-		{ PSEUDO,			DW,		"DW"	},
-		{ PSEUDO + ISIF,	ELSE,	"ELSE"	},
-		{ PSEUDO,			END,	"END"	},
-		{ PSEUDO + ISIF,	ENDI,	"ENDI"	},
-		{ TWOOP,			0x41,	"EOR"	},
-		{ PSEUDO,			EQU,	"EQU"	},
-		{ PSEUDO,			EXP,	"EXP"	},
-		{ PSEUDO + ISIF,	IF,		"IF"	},
-		{ INCOP,			0xe6,	"INC"	},
-		{ PSEUDO,			INCB,	"INCB"	},
-		{ PSEUDO,			INCL,	"INCL"	},
-		{ INHOP,			0xe8,	"INX"	},
-		{ INHOP,			0xc8,	"INY"	},
-		{ JUMP,				0x4c,	"JMP"	},
-		{ CALL,				0x20,	"JSR"	},
-		{ TWOOP,			0xa1,	"LDA"	},
-		{ LDXY,				0xa2,	"LDX"	},
-		{ LDXY,				0xa0,	"LDY"	},
-		{ LOGOP,			0x46,	"LSR"	},
-		{ INHOP,			0x4a,	"LSRA"	},
-		{ PSEUDO,			MSG,	"MSG"	},
-		{ INHOP,			0xea,	"NOP"	},
-		{ TWOOP,			0x01,	"ORA"	},
-		{ PSEUDO,			ORG,	"ORG"	},
-		{ PSEUDO,			PAGE,	"PAGE"	},
-		{ INHOP,			0x48,	"PHA"	},
-		{ INHOP,			0x08,	"PHP"	},
-		{ INHOP,			0x68,	"PLA"	},
-		{ INHOP,			0x28,	"PLP"	},
-		{ PSEUDO,			RMB,	"RMB"	},
-		{ LOGOP,			0x26,	"ROL"	},
-		{ INHOP,			0x2a,	"ROLA"	},
-		{ LOGOP,			0x66,	"ROR"	},
-		{ INHOP,			0x6a,	"RORA"	},
-		{ INHOP,			0x40,	"RTI"	},
-		{ INHOP,			0x60,	"RTS"	},
-		{ TWOOP,			0xe1,	"SBC"	},
-		{ INHOP,			0x38,	"SEC"	},
-		{ INHOP,			0xf8,	"SED"	},
-		{ INHOP,			0x78,	"SEI"	},
-		{ PSEUDO,			SET,	"SET"	},
-		{ TWOOP,			0x81,	"STA"	},
-		{ STXY,				0x86,	"STX"	},
-		{ STXY,				0x84,	"STY"	},
-		{ INHOP,			0xaa,	"TAX"	},
-		{ INHOP,			0xa8,	"TAY"	},
-		{ PSEUDO,			TITL,	"TITL"	},
-		{ INHOP,			0xba,	"TSX"	},
-		{ INHOP,			0x8a,	"TXA"	},
-		{ INHOP,			0x9a,	"TXS"	},
-		{ INHOP,			0x98,	"TYA"	}
-    };
+    SCRATCH KEYWORD *k;
 
-    return bsearchtbl(opctbl,opctbl + (sizeof(opctbl) / sizeof(OPCODE)),nam);
+    return (k = keyword(nam)) ? k -> code : NULL;
 }
 
 /*  Operator table search routine.  This routine pats down the		*/
@@ -172,52 +671,111 @@ OPCODE *find_code(char *nam) {
 /*  to it or NULL if the opcode doesn't exist.				*/
 
 OPCODE *find_operator(char *nam) {
-    static OPCODE oprtbl[] = {
-		{ REG,						'A',		"A"		},
-		{ BINARY + LOG1  + OPR,		AND,		"AND"	},
-		{ BINARY + RELAT + OPR,		'=',		"EQ"	},
-		{ BINARY + RELAT + OPR,		GE,			"GE"	},
-		{ BINARY + RELAT + OPR,		'>',		"GT"	},
-		{ UNARY  + UOP3  + OPR,		HIGH,		"HIGH"	},
-		{ BINARY + RELAT + OPR,		LE,			"LE"	},
-		{ UNARY  + UOP3  + OPR,		LOW,		"LOW"	},
-		{ BINARY + RELAT + OPR,		'<',		"LT"	},
-		{ BINARY + MULT  + OPR,		MOD,		"MOD"	},
-		{ BINARY + RELAT + OPR,		NE,			"NE"	},
-		{ UNARY  + UOP2  + OPR,		NOT,		"NOT"	},
-		{ BINARY + LOG2  + OPR,		OR,			"OR"	},
-		{ BINARY + MULT  + OPR,		SHL,		"SHL"	},
-		{ BINARY + MULT  + OPR,		SHR,		"SHR"	},
-		{ REG,						'X',		"X"		},
-		{ BINARY + LOG2  + OPR,		XOR,		"XOR"	},
-		{ REG,						'Y',		"Y"		},
-    };
+    SCRATCH KEYWORD *k;
 
-    return bsearchtbl(oprtbl,oprtbl + (sizeof(oprtbl) / sizeof(OPCODE)),nam);
+    return (k = keyword(nam)) ? k -> oper : NULL;
 }
 
-static OPCODE *bsearchtbl(OPCODE *lo, OPCODE *hi, char *nam) {
+/*  Packs a name, upper-cased, into an integer.  Returns 0 for a name	*/
+/*  too long to be a keyword.						*/
+
+static unsigned long long pack(char *nam) {
+    SCRATCH unsigned long long key;
     SCRATCH int i;
-    SCRATCH OPCODE *chk;
 
-    for (;;) {
-		chk = lo + (hi - lo) / 2;
-		if (!(i = ustrcmp(chk -> oname,nam))) return chk;
-		if (chk == lo) return NULL;
-		if (i < 0) lo = chk;
-		else hi = chk;
+    for (key = i = 0; *nam; ++i) {
+		if (i == KEYLEN) return 0;
+		key = (key << 8) + toupper(*nam++ & 0377);
     }
+    return key;
 }
 
-static int ustrcmp(char *s, char *t) {
-    SCRATCH int i;
+static KEYWORD *keyword(char *nam) {
+    SCRATCH unsigned long long key;
+    SCRATCH unsigned i;
+
+    if (!kwmult) build_keywords();
+    if (!(key = pack(nam))) return NULL;
+    i = kwslot[(key * kwmult) >> (64 - KEYBITS)];
+    return i && kwtbl[i - 1].key == key ? kwtbl + i - 1 : NULL;
+}
+
+static void build_keywords() {
+    SCRATCH unsigned i, n;
+    SCRATCH unsigned long long key;
+    SCRATCH OPCODE *o;
+    SCRATCH ENCODING *e;
+
+    for (n = 0, o = opctbl; o < opctbl + sizeof(opctbl) / sizeof(OPCODE); ++o) {
+		kwtbl[n].key = pack(o -> oname);  kwtbl[n++].code = o;
+    }
+    for (e = enctbl; e < enctbl + sizeof(enctbl) / sizeof(ENCODING); ++e) {
+		kwtbl[n].key = pack(e -> code.oname);  kwtbl[n++].code = &(e -> code);
+    }
+    for (o = oprtbl; o < oprtbl + sizeof(oprtbl) / sizeof(OPCODE); ++o) {
+		key = pack(o -> oname);
+		for (i = 0; i < n && kwtbl[i].key != key; ++i);
+		if (i == n) kwtbl[n++].key = key;
+		kwtbl[i].oper = o;
+    }
+    for (kwmult = 0x9e3779b97f4a7c15ull; ;
+		kwmult = (kwmult * 6364136223846793005ull + 1442695040888963407ull) | 1) {
+		memset(kwslot,0,sizeof(kwslot));
+		for (i = 0; i < n; ++i) {
+			key = (kwtbl[i].key * kwmult) >> (64 - KEYBITS);
+			if (kwslot[key]) break;
+			kwslot[key] = i + 1;
+		}
+		if (i == n) break;
+    }
+    return;
+}
+
+/*  Output files are created through these.  If atomic is set, a file	*/
+/*  is written under a temporary name beside it (one no other process	*/
+/*  or thread will pick) and renamed over the real one when it is	*/
+/*  closed, and the temporary is removed if the assembly stops first.	*/
+
+static FILE *create(char *nam, char *mode, char **tmp, int atomic) {
+    SCRATCH FILE *fp;
+
+    *tmp = NULL;
+    if (!atomic) return fopen(nam,mode);
+    if (!(*tmp = (char *)malloc(strlen(nam) + 40))) fatal_error(MEMFULL);
+    sprintf(*tmp,"%s.%lx.%lx~",nam,(unsigned long)getpid(),(unsigned long)(uintptr_t)tmp);
+    if (!(fp = fopen(*tmp,mode))) { free(*tmp);  *tmp = NULL; }
+    return fp;
+}
+
+/*  Closes output file fp, putting it in place under name nam.  Returns	*/
+/*  non-zero if it couldn't be written.					*/
 
-    while (!(i = toupper(*s++) - toupper(*t)) && *t++);
-    return i;
+static int commit(FILE *fp, char *nam, char **tmp) {
+    SCRATCH int n;
+
+    n = ferror(fp);
+    if (fclose(fp) == EOF) n = TRUE;
+    if (*tmp) {
+#ifdef _WIN32
+		if (!n) remove(nam);
+#endif
+		if (n || rename(*tmp,nam)) { remove(*tmp);  n = TRUE; }
+		free(*tmp);  *tmp = NULL;
+    }
+    return n;
+}
+
+/*  Closes output file fp without putting it in place.			*/
+
+static void scrap(FILE *fp, char **tmp) {
+    fclose(fp);
+    if (*tmp) { remove(*tmp);  free(*tmp);  *tmp = NULL; }
+    return;
 }
 
-/* export file pointer */
-static FILE *export = NULL;
+/* export file pointer, its name, and its temporary name */
+static THREAD FILE *export = NULL;
+static THREAD char *enam, *etmp = NULL;
 
 /*  Export file open routine.  If an export file is already open, a		*/
 /*  warning occurs.  If the export file doesn't open correctly, a		*/
@@ -226,7 +784,7 @@ static FILE *export = NULL;
 
 void eopen(char *nam) {
 	if (export) warning(TWOEXP);
-	else if (!(export = fopen(nam, "w"))) fatal_error(EXPOPEN);
+	else if (!(export = create(enam = nam, "w", &etmp, ctx -> atomic))) fatal_error(EXPOPEN);
 	else {
 		fprintf(export, "; Autogenerated export file - do not modify!\n\n");
 		if (ferror(export)) fatal_error(DSKFULL);
@@ -247,8 +805,11 @@ void eputs(SYMBOL *sym) {
 
 /*  Export file close routine. */
 void eclose() {
-	if (export) {
-		fclose(export);
+	FILE *fp;
+
+	if ((fp = export)) {
+		export = NULL;
+		if (commit(fp, enam, &etmp)) fatal_error(DSKFULL);
 	}
 }
 
@@ -257,7 +818,9 @@ void eclose() {
 /*  output routines to do all operations without the main routine		*/
 /*  having to fool with it.												*/
 
-static FILE *list = NULL;
+static THREAD FILE *list = NULL;
+static THREAD char *lnam, *ltmp = NULL;
+static THREAD LWRITER *lw = NULL;
 
 /*  Listing file open routine.  If a listing file is already open, a	*/
 /*  warning occurs.  If the listing file doesn't open correctly, a		*/
@@ -266,88 +829,450 @@ static FILE *list = NULL;
 
 void lopen(char *nam) {
     if (list) warning(TWOLST);
-    else if (!(list = fopen(nam,"w"))) fatal_error(LSTOPEN);
+    else if (!(list = create(lnam = nam,"w",&ltmp,ctx -> atomic))) fatal_error(LSTOPEN);
+    else {
+		if (!(lw = (LWRITER *)malloc(sizeof(LWRITER)))) fatal_error(MEMFULL);
+		lw -> fp = list;  lw -> failed = FALSE;  lw -> nbuf = 0;
+#ifdef LWRITER_THREAD
+		lw -> running = FALSE;
+		if (!(lw -> ring = (LISTROW *)malloc(LRING * sizeof(LISTROW)))) return;
+		atomic_init(&lw -> head,0);  atomic_init(&lw -> tail,0);
+		atomic_init(&lw -> idle,FALSE);  atomic_init(&lw -> full,FALSE);
+		atomic_init(&lw -> done,FALSE);  atomic_init(&lw -> lost,FALSE);
+		mtx_init(&lw -> lock,mtx_plain);  cnd_init(&lw -> wake);
+		if (thrd_create(&lw -> thread,lwrite,lw) == thrd_success) lw -> running = TRUE;
+		else {
+			mtx_destroy(&lw -> lock);  cnd_destroy(&lw -> wake);
+			free(lw -> ring);  lw -> ring = NULL;
+		}
+#endif
+    }
+    return;
+}
+
+/*  Listing file hold routine.  Once this is called, lputs() saves the	*/
+/*  listing lines in memory instead of writing them, so that lflag()	*/
+/*  can fill in errors found later.  lclose() writes them out, taking	*/
+/*  the object bytes from the held binary file.				*/
+
+static THREAD int lheld = FALSE;
+static THREAD LISTREC *lrecs = NULL;
+static THREAD unsigned long lcnt = 0, lsize = 0;
+static THREAD char *ltitle = NULL;
+
+void lhold() {
+    lheld = TRUE;
+    return;
+}
+
+/*  Listing capture routines, for the pass 2 workers.  Once lkeep() is	*/
+/*  called, lputs() packs the rows of the listing into memory instead	*/
+/*  of handing them to a listing writer.  lkept() returns how many	*/
+/*  bytes of rows are kept, and ltake() hands them over.  lmerge()	*/
+/*  hands rows a worker kept to the listing writer, counting off the	*/
+/*  pages as it goes.							*/
+
+static THREAD int lkeeping = FALSE;
+static THREAD char *lkrows = NULL;
+static THREAD size_t lklen = 0, lksize = 0;
+static THREAD LISTROW lkrow;
+
+void lkeep() {
+    lkeeping = TRUE;
+    return;
+}
+
+size_t lkept() {
+    return lklen;
+}
+
+char *ltake(size_t *len) {
+    SCRATCH char *p;
+
+    p = lkrows;  *len = lklen;
+    lkrows = NULL;  lklen = lksize = 0;
+    return p;
+}
+
+void lmerge(char *rows, size_t len) {
+    SCRATCH char *p;
+    SCRATCH LISTROW *r;
+    SCRATCH unsigned n;
+
+    if (!list) return;
+    eject = FALSE;
+    for (p = rows; p < rows + len; p += offsetof(LISTROW,text) + n) {
+		r = lslot();
+		memcpy(r,p,offsetof(LISTROW,text));
+		memcpy(r -> text,p + offsetof(LISTROW,text),n = r -> len);
+		lpage(r);  lpush();
+    }
     return;
 }
 
 /*  Listing file line output routine.  This routine processes the		*/
 /*  source line saved by popc() and the output of the line assembler in	*/
-/*  buffer obj into a line of the listing.  If the disk fills up, a		*/
+/*  buffer obj into rows of the listing for the listing writer.  If	*/
+/*  the disk fills up (which may be found a few rows later), a		*/
 /*  fatal error occurs.													*/
 
 void lputs() {
-    SCRATCH int i, j;
+    SCRATCH LISTREC *r;
+
+    if (lkeeping) list_line();
+    else if (list) {
+		if (!lheld) { list_line();  return; }
+		if (lcnt == lsize) {
+			lsize = lsize ? lsize * 2 : 1024;
+			if (!(lrecs = (LISTREC *)realloc(lrecs, lsize * sizeof(LISTREC))))
+				fatal_error(MEMFULL);
+		}
+		if (!ltitle || strcmp(ltitle, title)) ltitle = intern(title);
+		r = lrecs + lcnt++;
+		r -> errcode = errcode;  r -> listhex = listhex;  r -> eject = eject;
+		r -> address = address;  r -> bytes = bytes;  r -> pagelen = pagelen;
+		r -> offset = btell();  r -> title = ltitle;
+		r -> text = strcpy((char *)arena(strlen(line) + 1), line);
+    }
+    return;
+}
+
+/*  Return the number of listing lines held so far.			*/
+
+unsigned long ltell() {
+    return lcnt;
+}
+
+/*  Set the error code of a held listing line.				*/
+
+void lflag(unsigned long rec, char code) {
+    if (rec < lcnt) lrecs[rec].errcode = code;
+    return;
+}
+
+/*  Set the address shown on a held listing line.			*/
+
+void laddr(unsigned long rec, unsigned addr) {
+    if (rec < lcnt) lrecs[rec].address = addr;
+    return;
+}
+
+static void list_line() {
+    SCRATCH int i;
     SCRATCH unsigned *o;
+    SCRATCH LISTROW *r;
+
+    i = bytes;  o = obj;
+    do {
+		r = lslot();
+		r -> errcode = errcode;  r -> listhex = listhex;  r -> address = address;
+		for (r -> nbytes = 0; listhex && i && r -> nbytes < 4; --i, ++address)
+			r -> obj[(int)r -> nbytes++] = *o++;
+		if ((r -> len = strlen(line)) > MAXLINE + 1) r -> len = MAXLINE + 1;
+		memcpy(r -> text,line,r -> len);  strcpy(line,"\n");
+		lpage(r);  lpush();
+    } while (listhex && i);
+    return;
+}
 
-    if (list) {
-		i = bytes;  o = obj;
-		do {
-			fprintf(list,"%c  ",errcode);
-			if (listhex) {
-				fprintf(list,"%04x  ",address);
-				for (j = 4; j; --j) {
-					if (i) { --i;  ++address;  fprintf(list," %02x",*o++); }
-					else fprintf(list,"   ");
-				}
-			}
-			else fprintf(list,"%18s","");
-			fprintf(list,"   %s",line);  strcpy(line,"\n");
-			check_page();
-			if (ferror(list)) fatal_error(DSKFULL);
-		} while (listhex && i);
+/*  Counts off row r of the listing, marking it if a new page starts	*/
+/*  after it.								*/
+
+static void lpage(LISTROW *r) {
+    if ((r -> ff = check_page()) && title[0]) {
+		if (!ltitle || strcmp(ltitle, title)) ltitle = intern(title);
+		r -> title = ltitle;
     }
+    else r -> title = NULL;
     return;
 }
 
+/*  Listing writer routines (see LWRITER in A65.H).  lslot() hands out	*/
+/*  the record for the next row, waiting for room in the ring if the	*/
+/*  writer has fallen that far behind, and lpush() hands it over.  A	*/
+/*  disk full error found by the writer is a fatal error the next time	*/
+/*  a row is made.							*/
+
+static LISTROW *lslot() {
+#ifdef LWRITER_THREAD
+    SCRATCH unsigned long h;
+#endif
+
+    if (lkeeping) return &lkrow;
+#ifdef LWRITER_THREAD
+    if (lw -> running) {
+		if (atomic_load(&lw -> lost)) fatal_error(DSKFULL);
+		h = atomic_load_explicit(&lw -> head,memory_order_relaxed);
+		if (h - atomic_load(&lw -> tail) == LRING) {
+			mtx_lock(&lw -> lock);  atomic_store(&lw -> full,TRUE);
+			while (h - atomic_load(&lw -> tail) == LRING) cnd_wait(&lw -> wake,&lw -> lock);
+			atomic_store(&lw -> full,FALSE);  mtx_unlock(&lw -> lock);
+		}
+		return lw -> ring + h % LRING;
+    }
+#endif
+    return &lw -> one;
+}
+
+static void lpush() {
+    SCRATCH char *p;
+    SCRATCH size_t n;
+
+    if (lkeeping) {
+		n = offsetof(LISTROW,text) + lkrow.len;
+		if (lklen + n > lksize) {
+			lksize = (lklen + n) * 2;
+			if (!(p = (char *)realloc(lkrows,lksize))) fatal_error(MEMFULL);
+			lkrows = p;
+		}
+		memcpy(lkrows + lklen,&lkrow,n);  lklen += n;
+		return;
+    }
+#ifdef LWRITER_THREAD
+    if (lw -> running) {
+		atomic_fetch_add(&lw -> head,1);
+		if (atomic_load(&lw -> idle)) {
+			mtx_lock(&lw -> lock);  cnd_broadcast(&lw -> wake);  mtx_unlock(&lw -> lock);
+		}
+		return;
+    }
+#endif
+    p = lrow(lroom(lw),&lw -> one);
+    lw -> nbuf = p - lw -> buf;
+    if (lw -> failed) fatal_error(DSKFULL);
+    return;
+}
+
+/*  Returns where the next row goes in the buffer, writing the buffer	*/
+/*  out first if the row might not fit.					*/
+
+static char *lroom(LWRITER *w) {
+    if (w -> nbuf + LROWMAX > LBUFSIZE) lflush(w);
+    return w -> buf + w -> nbuf;
+}
+
+/*  Writes the buffer out, setting failed if it can't be.		*/
+
+static void lflush(LWRITER *w) {
+    if (w -> nbuf && fwrite(w -> buf,1,w -> nbuf,w -> fp) != w -> nbuf)
+		w -> failed = TRUE;
+    w -> nbuf = 0;
+    return;
+}
+
+/*  Waits for the writer to finish the rows it has been given, and	*/
+/*  stops it.  The rows after that are formatted as they're made.	*/
+
+static void lstop() {
+#ifdef LWRITER_THREAD
+    if (lw -> running) {
+		mtx_lock(&lw -> lock);
+		atomic_store(&lw -> done,TRUE);  cnd_broadcast(&lw -> wake);
+		mtx_unlock(&lw -> lock);
+		thrd_join(lw -> thread,NULL);
+		mtx_destroy(&lw -> lock);  cnd_destroy(&lw -> wake);
+		free(lw -> ring);  lw -> ring = NULL;  lw -> running = FALSE;
+    }
+#endif
+    return;
+}
+
+#ifdef LWRITER_THREAD
+
+/*  Writer thread.  The buffer is written out whenever the ring runs	*/
+/*  dry, so the listing doesn't lag far behind the assembly.		*/
+
+static int lwrite(void *arg) {
+    SCRATCH LWRITER *w;
+    SCRATCH unsigned long t;
+    SCRATCH char *p;
+
+    w = (LWRITER *)arg;
+    for (t = 0;;) {
+		if (t == atomic_load(&w -> head)) {
+			if (atomic_load(&w -> done) && t == atomic_load(&w -> head)) break;
+			lflush(w);
+			mtx_lock(&w -> lock);  atomic_store(&w -> idle,TRUE);
+			while (t == atomic_load(&w -> head) && !atomic_load(&w -> done))
+				cnd_wait(&w -> wake,&w -> lock);
+			atomic_store(&w -> idle,FALSE);  mtx_unlock(&w -> lock);
+			continue;
+		}
+		p = lrow(lroom(w),w -> ring + t % LRING);
+		w -> nbuf = p - w -> buf;
+		if (w -> failed) atomic_store(&w -> lost,TRUE);
+		atomic_store(&w -> tail,++t);
+		if (atomic_load(&w -> full)) {
+			mtx_lock(&w -> lock);  cnd_broadcast(&w -> wake);  mtx_unlock(&w -> lock);
+		}
+    }
+    return 0;
+}
+
+#endif
+
+/*  Formats row r at p, returning the end of it.			*/
+
+static char *lrow(char *p, LISTROW *r) {
+    SCRATCH int j;
+    SCRATCH size_t n;
+
+    *p++ = r -> errcode;  *p++ = ' ';  *p++ = ' ';
+    if (r -> listhex) {
+		p = lhex(p,r -> address,4);  *p++ = ' ';  *p++ = ' ';
+		for (j = 0; j < 4; ++j) {
+			*p++ = ' ';
+			if (j < r -> nbytes) p = lhex(p,r -> obj[j],2);
+			else { *p++ = ' ';  *p++ = ' '; }
+		}
+    }
+    else { memset(p,' ',18);  p += 18; }
+    *p++ = ' ';  *p++ = ' ';  *p++ = ' ';
+    memcpy(p,r -> text,r -> len);  p += r -> len;
+    if (r -> ff) {
+		*p++ = '\f';
+		if (r -> title) {
+			memcpy(p,r -> title,n = strlen(r -> title));  p += n;
+			*p++ = '\n';  *p++ = '\n';
+		}
+    }
+    return p;
+}
+
+/*  Puts u in lower case hex at p, with at least width digits, and	*/
+/*  returns the end of it.						*/
+
+static char *lhex(char *p, unsigned u, int width) {
+    SCRATCH int n;
+    char d[16];
+
+    n = 0;
+    do { d[n++] = "0123456789abcdef"[u & 0xf];  u >>= 4; } while (u);
+    while (n < width) d[n++] = '0';
+    while (n) *p++ = d[--n];
+    return p;
+}
+
 /*  Listing file close routine.  The symbol table is appended to the	*/
 /*  listing in alphabetic order by symbol name, and the listing file is	*/
 /*  closed.  If the disk fills up, a fatal error occurs.				*/
 
-static int col = 0;
+static THREAD int col = 0;
 
 void lclose() {
+    SCRATCH unsigned long n;
+    SCRATCH LISTREC *r;
+    SCRATCH FILE *fp;
+    SCRATCH char *p;
+
     if (list) {
-		if (sroot) {
-			list_sym(sroot);
-			if (col) fprintf(list,"\n");
+		for (n = 0; n < lcnt; ++n) {
+			r = lrecs + n;
+			errcode = r -> errcode;  listhex = r -> listhex;  eject = r -> eject;
+			address = r -> address;  bytes = r -> bytes;  pagelen = r -> pagelen;
+			strcpy(title, r -> title);  strcpy(line, r -> text);
+			bfetch(r -> offset, bytes);
+			list_line();
 		}
-		fprintf(list,"\f");
-		if (ferror(list) || fclose(list) == EOF) fatal_error(DSKFULL);
+		lstop();
+		if (lw -> failed) fatal_error(DSKFULL);
+		list_sym();
+		p = lroom(lw);
+		if (col) *p++ = '\n';
+		*p++ = '\f';
+		lw -> nbuf = p - lw -> buf;  lflush(lw);
+		if (lw -> failed) fatal_error(DSKFULL);
+		free(lw);  lw = NULL;
+		fp = list;  list = NULL;
+		if (commit(fp,lnam,&ltmp)) fatal_error(DSKFULL);
     }
     return;
 }
 
-static void list_sym(SYMBOL *sp) {
-    if (sp) {
-		list_sym(sp -> left);
-		fprintf(list,"%04x  %-10s",sp -> valu,sp -> sname);
-		if ((++col) % SYMCOLS) fprintf(list,"    ");
+/*  The hash table is in no particular order, so the defined symbols	*/
+/*  are gathered up and sorted by name for the listing.			*/
+
+static int symcmp(const void *a, const void *b) {
+    return strcmp((*(SYMBOL * const *)a) -> sname,(*(SYMBOL * const *)b) -> sname);
+}
+
+/*  Collects the defined symbols of table sc and its scopes into v,	*/
+/*  returning the number found.  It recurses, so no SCRATCH here.	*/
+
+static unsigned gather(SCOPE *sc, SYMBOL **v) {
+    unsigned i, n;
+
+    for (i = n = 0; i < sc -> size; ++i) {
+		if (sc -> slot[i].sym && sc -> slot[i].sym -> attr) v[n++] = sc -> slot[i].sym;
+		if (sc -> slot[i].scope) n += gather(sc -> slot[i].scope,v + n);
+    }
+    return n;
+}
+
+static void list_sym() {
+    SCRATCH unsigned i, n;
+    SCRATCH size_t k;
+    SCRATCH SYMBOL **v;
+    SCRATCH char *p;
+
+    if (!(v = (SYMBOL **)malloc((nsyms + 1) * sizeof(SYMBOL *))))
+		fatal_error(MEMFULL);
+    n = gather(&globals,v);
+    qsort(v,n,sizeof(SYMBOL *),symcmp);
+    for (i = 0; i < n; ++i) {
+		p = lroom(lw);
+		p = lhex(p,v[i] -> valu,4);  *p++ = ' ';  *p++ = ' ';
+		k = strlen(v[i] -> sname);
+		if (k > MAXLINE) k = MAXLINE;
+		memcpy(p,v[i] -> sname,k);  p += k;
+		for (; k < 10; ++k) *p++ = ' ';
+		if ((++col) % SYMCOLS) { memcpy(p,"    ",4);  p += 4; }
 		else {
-			fprintf(list,"\n");
-			if (sp -> right) check_page();
+			*p++ = '\n';
+			if (i + 1 < n && check_page()) {
+				*p++ = '\f';
+				if (title[0]) {
+					memcpy(p,title,k = strlen(title));  p += k;
+					*p++ = '\n';  *p++ = '\n';
+				}
+			}
 		}
-		list_sym(sp -> right);
+		lw -> nbuf = p - lw -> buf;
     }
+    free(v);
+    if (lw -> failed) fatal_error(DSKFULL);
     return;
 }
 
-static void check_page() {
+/*  Counts off a row of the listing.  Returns TRUE if a new page starts	*/
+/*  after it.								*/
+
+static int check_page() {
     if (pagelen && !--listleft) eject = TRUE;
     if (eject) {
-		eject = FALSE;  listleft = pagelen;  fprintf(list,"\f");
-		if (title[0]) { listleft -= 2;  fprintf(list,"%s\n\n",title); }
+		eject = FALSE;  listleft = pagelen;
+		if (title[0]) listleft -= 2;
+		return TRUE;
     }
-    return;
+    return FALSE;
 }
 
 /*  Buffer storage for binary output file.  This allows the file	*/
 /*  output routines to do all of the required buffering and record	*/
 /*  forming without the	main routine having to fool with it.		*/
 
-static FILE *outfile = NULL;
-static unsigned cnt = 0;
-static unsigned addr = 0;
-static uint8_t buf[HEXSIZE];
+static THREAD FILE *outfile = NULL;
+static THREAD char *bnam, *btmp = NULL;
+static THREAD unsigned cnt = 0;
+static THREAD unsigned long addr = 0;
+static THREAD uint8_t buf[HEXSIZE];
+
+/*  When the binary file is held, the whole image stays in memory	*/
+/*  until bclose() so bpatch() can change bytes already output.	*/
+
+static THREAD int bheld = FALSE;
+static THREAD uint8_t *image = NULL;
+static THREAD unsigned long imgsize = 0;
 
 /*  Binary file open routine.  If the file is already open, a warning	*/
 /*  occurs.  If the file doesn't open correctly, a fatal error occurs.	*/
@@ -359,18 +1284,33 @@ void bopen(char *filename) {
 		warning(TWOHEX);
 	}
 	else {
-		outfile = fopen(filename, "wb");
+		outfile = create(bnam = filename, "wb", &btmp, ctx -> atomic);
 		if (!outfile) {
 			fatal_error(HEXOPEN);
 		}
 	}
 }
 
+/*  Binary file hold routine.  Once this is called, the output is kept	*/
+/*  in memory (whether or not a binary file is open) and written out	*/
+/*  by bclose().														*/
+
+void bhold() {
+	bheld = TRUE;
+}
+
 /*  Binary file write routine.  The data byte is appended to the output	*/
 /*  buffer.  If the buffer fills up, it gets written to disk. 			*/
 
 void bputc(unsigned c) {
-	if (outfile) {
+	if (bheld) {
+		if (addr == imgsize) {
+			imgsize = imgsize ? imgsize * 2 : HEXSIZE;
+			if (!(image = (uint8_t *)realloc(image, imgsize))) fatal_error(MEMFULL);
+		}
+		image[addr++] = c;
+	}
+	else if (outfile) {
 		buf[cnt++] = c;
 		if (cnt == HEXSIZE) record();
 	}
@@ -387,16 +1327,75 @@ void bpad(unsigned len) {
 	}
 }
 
+/*  Writes len bytes from p to the output file, as bputc() would.		*/
+
+void bwrite(unsigned char *p, unsigned long len) {
+	unsigned long i;
+
+	if (bheld) {
+		if (addr + len > imgsize) {
+			imgsize = (addr + len) * 2;
+			if (!(image = (uint8_t *)realloc(image, imgsize))) fatal_error(MEMFULL);
+		}
+		memcpy(image + addr, p, len);
+		addr += len;
+	}
+	else for (i = 0; i < len; i++) {
+		bputc(p[i]);
+	}
+}
+
+/*  Returns the offset in the output file of the next byte bputc()		*/
+/*  will write.															*/
+
+unsigned long btell() {
+	return addr + cnt;
+}
+
+/*  Replaces a byte of the held binary file.							*/
+
+void bpatch(unsigned long offset, unsigned c) {
+	if (bheld && offset < addr) image[offset] = c;
+}
+
+/*  Copies bytes of the held binary file back into buffer obj.			*/
+
+void bfetch(unsigned long offset, unsigned len) {
+	unsigned i;
+
+	for (i = 0; i < len && offset + i < addr; i++) {
+		obj[i] = image[offset + i];
+	}
+}
+
 /*  Binary file close routine. All buffered data is written to disk,	*/
 /*  and the output file is closed.										*/
 
 void bclose() {
+	FILE *fp;
+
+	if (relocate) rbuild();
 	if (outfile) {
-		if (cnt) record();
-		fclose(outfile);
+		if (bheld) {
+			if (fwrite(image, 1, addr, outfile) != addr) fatal_error(DSKFULL);
+		}
+		else if (cnt) record();
+		fp = outfile;  outfile = NULL;
+		if (commit(fp, bnam, &btmp)) fatal_error(DSKFULL);
 	}
 }
 
+/*  Hands over the held binary file image, setting *len to its length.	*/
+/*  The caller frees it.												*/
+
+unsigned char *btake(unsigned long *len) {
+	uint8_t *p;
+
+	p = image;  *len = addr;
+	image = NULL;  imgsize = addr = 0;
+	return p;
+}
+
 static void record() {
 	if (fwrite(buf, 1, cnt, outfile) != cnt) {
 		fatal_error(DSKFULL);
@@ -406,6 +1405,1162 @@ static void record() {
 	cnt = 0;
 }
 
+/*  Relocatable object.  The sections and imported symbols are kept in	*/
+/*  rbases in the order the source first names them, so that both	*/
+/*  passes number them alike.  The held binary file is the image of	*/
+/*  the section being assembled into (rcur), and is traded for another	*/
+/*  section's when the source switches sections.  bclose() then puts	*/
+/*  the object file together from the sections in place of the image.	*/
+
+static THREAD RBASE *rbases = NULL;
+static THREAD unsigned nbases = 0, basesize = 0, rcur = 0;
+static THREAD SYMBOL **rexps = NULL;
+static THREAD unsigned nrexps = 0, rexpsize = 0;
+
+/*  Finds the section (or import if ext is set) named nam, adding it	*/
+/*  if need be.  Returns its base number, shifted into place.		*/
+
+static unsigned rfind(char *nam, int ext) {
+    SCRATCH RBASE *b;
+
+    nam = intern(nam);
+    for (b = rbases; b < rbases + nbases; ++b)
+		if (b -> name == nam && (b -> kind == OBJEXTRN) == ext) return reltag(b - rbases + 1);
+    if (nbases == RELMAX) fatal_error(SYMBOLS);
+    if (nbases == basesize) {
+		basesize = basesize ? basesize * 2 : 16;
+		if (!(rbases = (RBASE *)realloc(rbases,basesize * sizeof(RBASE)))) fatal_error(MEMFULL);
+    }
+    b = rbases + nbases++;
+    memset(b,0,sizeof(RBASE));
+    b -> name = nam;  b -> kind = ext ? OBJEXTRN : OBJSECT;  b -> align = 1;
+    return reltag(nbases);
+}
+
+unsigned rsect(char *nam) {
+    return rfind(nam,FALSE);
+}
+
+unsigned rextern(char *nam) {
+    return rfind(nam,TRUE);
+}
+
+void rstart() {
+    SCRATCH RBASE *b;
+
+    for (b = rbases; b < rbases + nbases; ++b) {
+		b -> pc = 0;  b -> align = 1;
+		if (b -> kind == OBJFIXED) { b -> kind = OBJSECT;  b -> org = 0; }
+    }
+    return;
+}
+
+unsigned rswitch(unsigned tag, unsigned *pc) {
+    SCRATCH RBASE *b;
+
+    if (rcur) {
+		b = rbases + rcur - 1;
+		b -> pc = *pc;  b -> image = image;  b -> size = addr;  b -> imgsize = imgsize;
+    }
+    b = rbases + (rcur = relnum(tag)) - 1;
+    *pc = b -> pc;  image = b -> image;  addr = b -> size;  imgsize = b -> imgsize;
+    return b -> kind == OBJFIXED ? 0 : tag;
+}
+
+void rorg(unsigned u) {
+    rbases[rcur - 1].kind = OBJFIXED;  rbases[rcur - 1].org = u;
+    return;
+}
+
+int ralign(unsigned long u) {
+    SCRATCH unsigned long a, b, t;
+
+    if (!u) return FALSE;
+    for (a = rbases[rcur - 1].align, b = u; b; t = a % b, a = b, b = t);
+    if ((u = rbases[rcur - 1].align / a * u) > 0x10000) return FALSE;
+    rbases[rcur - 1].align = u;
+    return TRUE;
+}
+
+void rput(unsigned type, unsigned long offset, unsigned tag, unsigned u) {
+    SCRATCH RBASE *b;
+    SCRATCH unsigned char *p;
+
+    b = rbases + rcur - 1;
+    if (b -> nrel == b -> relsize) {
+		b -> relsize = b -> relsize ? b -> relsize * 2 : 64;
+		if (!(b -> rel = (unsigned char *)realloc(b -> rel,b -> relsize * RELSIZE)))
+			fatal_error(MEMFULL);
+    }
+    p = b -> rel + b -> nrel++ * RELSIZE;
+    p[0] = low(offset);  p[1] = high(offset);  p[2] = type;
+    p[3] = low(relnum(tag));  p[4] = high(relnum(tag));
+    p[5] = low(u);  p[6] = high(u);
+    return;
+}
+
+int rexport(SYMBOL *sym) {
+    SCRATCH unsigned i;
+
+    if (sym -> rel & RELPART ||
+		(sym -> rel && rbases[relnum(sym -> rel) - 1].kind == OBJEXTRN)) return FALSE;
+    for (i = 0; i < nrexps; ++i) if (rexps[i] == sym) return TRUE;
+    if (nrexps == rexpsize) {
+		rexpsize = rexpsize ? rexpsize * 2 : 64;
+		if (!(rexps = (SYMBOL **)realloc(rexps,rexpsize * sizeof(SYMBOL *))))
+			fatal_error(MEMFULL);
+    }
+    rexps[nrexps++] = sym;
+    return TRUE;
+}
+
+/*  Forgets the sections and imports.  The image of the current	*/
+/*  section is the held binary file's, so it's left to the caller.	*/
+
+static void rclear() {
+    SCRATCH unsigned i;
+
+    for (i = 0; i < nbases; ++i) {
+		if (i + 1 != rcur) free(rbases[i].image);
+		free(rbases[i].rel);
+    }
+    nbases = rcur = 0;
+    return;
+}
+
+/*  Puts the object file together in the held binary file, in the	*/
+/*  layout given in A65.H.						*/
+
+static void rbuild() {
+    SCRATCH RBASE *b;
+    SCRATCH unsigned long i;
+    SCRATCH char *s;
+
+    if (rcur) {
+		b = rbases + rcur - 1;
+		b -> image = image;  b -> size = addr;  b -> imgsize = imgsize;
+    }
+    image = NULL;  addr = imgsize = 0;  rcur = 0;
+    for (s = OBJMAGIC; *s; bputc(*s++));
+    rword(nbases);
+    for (b = rbases; b < rbases + nbases; ++b) {
+		bputc(b -> kind);
+		for (s = b -> name; bputc(*s), *s; ++s);
+		if (b -> kind == OBJEXTRN) continue;
+		rword(b -> org);
+		rword(b -> align);  rword(b -> align >> 16);
+		rword(b -> size);  rword(b -> size >> 16);
+		rword(b -> nrel);  rword(b -> nrel >> 16);
+		for (i = 0; i < b -> size; bputc(b -> image[i++]));
+		for (i = 0; i < b -> nrel * RELSIZE; bputc(b -> rel[i++]));
+		free(b -> image);  free(b -> rel);  b -> image = b -> rel = NULL;
+    }
+    rword(nrexps);
+    for (i = 0; i < nrexps; ++i) {
+		for (s = rexps[i] -> sname; bputc(*s), *s; ++s);
+		rword(relnum(rexps[i] -> rel));  rword(rexps[i] -> valu);
+    }
+    return;
+}
+
+static void rword(unsigned long u) {
+    bputc(low(u));  bputc(high(u));
+    return;
+}
+
+/*  Source file cache.  Each file is read into memory the first time	*/
+/*  it's opened, and the same copy is handed out on every pass after	*/
+/*  that.  Text (INCL) and binary (INCB) copies are kept apart since	*/
+/*  they differ on systems that translate text files.  The cache is	*/
+/*  shared by every thread (slock guards the list) and lasts from one	*/
+/*  assembly to the next.  An entry never changes once it's made:  a	*/
+/*  file that has changed gets a new entry, and the old one is marked	*/
+/*  stale and freed once no assembly is using it.  Each assembly keeps	*/
+/*  the entries it has opened in sseen, so it sees the same copy of a	*/
+/*  file on every pass.  Entries the include file reader (see READER	*/
+/*  in A65.H) is still reading are kept in sbusy, and sopen() waits on	*/
+/*  sready for them rather than reading the file a second time.  The	*/
+/*  names of files the assembly asked for that weren't there are kept	*/
+/*  in smiss, each ending with a \0.					*/
+
+static SRCFILE *sfiles = NULL, *sbusy = NULL;
+static THREAD SRCFILE **sseen = NULL;
+static THREAD unsigned nseen = 0, seensize = 0;
+static THREAD char *smiss = NULL;
+static THREAD size_t nmiss = 0, misssize = 0;
+
+#ifndef __STDC_NO_THREADS__
+static mtx_t slock;
+static cnd_t sready;
+static once_flag sonce = ONCE_FLAG_INIT;
+static THREAD READER *reader = NULL;
+static THREAD thrd_t rthread;
+
+static int readahead(void *arg);
+static void rscan(READER *r, SRCFILE *sf, unsigned depth);
+static SRCFILE *rfetch(char *nam, int binary);
+static void srelease(SRCFILE *sf);
+
+static void sinit() {
+    mtx_init(&slock,mtx_plain);  cnd_init(&sready);
+    return;
+}
+
+#define	slocked()	(call_once(&sonce,sinit), mtx_lock(&slock))
+#define	sunlocked()	mtx_unlock(&slock)
+#define	swait()		cnd_wait(&sready,&slock)
+#else
+#define	slocked()
+#define	sunlocked()
+#define	swait()
+#endif
+
+/*  A file's time, as finely as the system keeps it.			*/
+
+#if defined(_WIN32) || defined(__APPLE__)
+#define	mtimeof(st)	((long long)(st).st_mtime)
+#else
+#define	mtimeof(st)	((long long)(st).st_mtim.tv_sec * 1000000000 + (st).st_mtim.tv_nsec)
+#endif
+
+/*  Source file open routine.  Returns the cached contents of the named	*/
+/*  file, reading the file the first time, or the first time in this	*/
+/*  assembly that it's found to have changed.  If the file doesn't	*/
+/*  open, NULL is returned.  If the file can't be read, a fatal error	*/
+/*  occurs.								*/
+
+SRCFILE *sopen(char *nam, int binary) {
+    SCRATCH SRCFILE *sf, *nf;
+    SCRATCH unsigned i;
+    SCRATCH char *msg, *path;
+    struct stat st;
+    FILE *fp;
+
+    for (i = 0; i < nseen; ++i)
+		if ((sseen[i] -> mem || sseen[i] -> binary == binary) &&
+			!strcmp(sseen[i] -> sname,nam)) return sseen[i];
+    if (nseen == seensize) {
+		seensize = seensize ? seensize * 2 : 16;
+		if (!(sseen = (SRCFILE **)realloc(sseen,seensize * sizeof(SRCFILE *))))
+			fatal_error(MEMFULL);
+    }
+    path = realpath(nam,NULL);
+    slocked();
+    while (sbusied(path,binary)) swait();
+    sf = sfind(nam,path,binary);
+    if (sf && (sf -> mem || (!stat(nam,&st) && sf -> size == (long long)st.st_size &&
+		sf -> mtime == mtimeof(st)))) {
+		++sf -> users;  sunlocked();
+		free(path);  return sseen[nseen++] = sf;
+    }
+    sunlocked();
+
+    if (!path || stat(nam,&st) || !(fp = fopen(nam, binary ? "rb" : "r"))) {
+		if (!path) smissed(nam);
+		free(path);  return NULL;
+    }
+    nf = snew(nam,path,binary);  free(path);
+    if (!nf) { fclose(fp);  fatal_error(MEMFULL); }
+    nf -> size = st.st_size;  nf -> mtime = mtimeof(st);
+    if ((msg = sread(nf,fp))) { free(nf -> text);  free(nf);  fatal_error(msg); }
+
+    slocked();
+    sf = sadd(nf);
+    sunlocked();
+    return sseen[nseen++] = sf;
+}
+
+/*  Adds the name of a file that isn't there to smiss, if it's not in	*/
+/*  it already.  If there's no room, the name is left out.		*/
+
+static void smissed(char *nam) {
+    SCRATCH char *p;
+    SCRATCH size_t n;
+
+    for (p = smiss; p < smiss + nmiss; p += strlen(p) + 1)
+		if (!strcmp(p,nam)) return;
+    n = strlen(nam) + 1;
+    if (nmiss + n > misssize) {
+		misssize = (nmiss + n) * 2;
+		if (!(p = (char *)realloc(smiss,misssize))) { misssize = nmiss;  return; }
+		smiss = p;
+    }
+    memcpy(smiss + nmiss,nam,n);  nmiss += n;
+    return;
+}
+
+/*  Finds the newest entry for the named file, whose full path is path	*/
+/*  (NULL if it has none, in which case only a file handed over in	*/
+/*  memory will do).  slock must be held.				*/
+
+static SRCFILE *sfind(char *nam, char *path, int binary) {
+    SCRATCH SRCFILE *sf;
+
+    for (sf = sfiles; sf; sf = sf -> next)
+		if (!sf -> stale && !strcmp(sf -> sname,nam) && (sf -> mem ||
+			(path && sf -> binary == binary && !strcmp(sf -> path,path)))) break;
+    return sf;
+}
+
+/*  Makes a new, empty entry that isn't in the list yet.  Returns NULL	*/
+/*  if there's no room for it.						*/
+
+static SRCFILE *snew(char *nam, char *path, int binary) {
+    SCRATCH SRCFILE *sf;
+    SCRATCH size_t n;
+
+    n = strlen(nam) + 1;
+    if ((sf = (SRCFILE *)calloc(1,sizeof(SRCFILE) + n + strlen(path)))) {
+		strcpy(sf -> sname,nam);  sf -> binary = binary;
+		strcpy(sf -> path = sf -> sname + n,path);
+    }
+    return sf;
+}
+
+/*  Reads the open file fp into entry sf and closes it.  Returns NULL,	*/
+/*  or the fatal error message if the file can't be read.		*/
+
+static char *sread(SRCFILE *sf, FILE *fp) {
+    SCRATCH size_t n, size;
+    SCRATCH char *p;
+
+    size = 0;
+    do {
+		if (sf -> len == size) {
+			size = size ? size * 2 : HEXSIZE;
+			if (!(p = (char *)realloc(sf -> text,size))) {
+				fclose(fp);  return MEMFULL;
+			}
+			sf -> text = p;
+		}
+		n = fread(sf -> text + sf -> len,1,size - sf -> len,fp);
+		sf -> len += n;
+    } while (n);
+    n = ferror(fp);
+    fclose(fp);
+    return n ? ASMREAD : NULL;
+}
+
+/*  Puts the entry nf just read into the list, unless an entry for the	*/
+/*  same copy of the file got there first, and counts a user of the	*/
+/*  one kept, which is returned.  slock must be held.			*/
+
+static SRCFILE *sadd(SRCFILE *nf) {
+    SCRATCH SRCFILE *sf;
+
+    if ((sf = sfind(nf -> sname,nf -> path,nf -> binary)) && !sf -> mem &&
+		sf -> size == nf -> size && sf -> mtime == nf -> mtime) {
+		free(nf -> text);  free(nf);
+    }
+    else {
+		if (sf) sdrop(sf);
+		nf -> next = sfiles;  sfiles = sf = nf;
+    }
+    ++sf -> users;
+    return sf;
+}
+
+/*  Tells whether the include file reader is reading the file whose	*/
+/*  full path is path.  slock must be held.				*/
+
+static int sbusied(char *path, int binary) {
+    SCRATCH SRCFILE *sf;
+
+    if (path)
+		for (sf = sbusy; sf; sf = sf -> next)
+			if (sf -> binary == binary && !strcmp(sf -> path,path)) return TRUE;
+    return FALSE;
+}
+
+/*  Marks an entry stale, freeing it if no assembly is using it.  slock	*/
+/*  must be held.							*/
+
+static void sdrop(SRCFILE *sf) {
+    SCRATCH SRCFILE **p;
+
+    sf -> stale = TRUE;
+    if (!sf -> users) {
+		for (p = &sfiles; *p != sf; p = &((*p) -> next));
+		*p = sf -> next;
+		free(sf -> text);  free(sf);
+    }
+    return;
+}
+
+/*  Sets sum to the hash of the contents of entry sf, working it out	*/
+/*  the first time.							*/
+
+static void shash(SRCFILE *sf, unsigned char *sum) {
+    SCRATCH int hashed;
+    HASH h;
+
+    slocked();
+    if ((hashed = sf -> hashed)) memcpy(sum,sf -> hash,HASHSIZE);
+    sunlocked();
+    if (hashed) return;
+    hinit(&h);  hadd(&h,sf -> text,sf -> len);  hdone(&h,sum);
+    slocked();
+    memcpy(sf -> hash,sum,HASHSIZE);  sf -> hashed = TRUE;
+    sunlocked();
+    return;
+}
+
+/*  Hand the cache a file in memory.					*/
+
+void a65n_source(char *nam, char *text, size_t len) {
+    SCRATCH SRCFILE *sf, *nf;
+
+    if (!(nf = snew(nam,nam,FALSE))) fatal_error(MEMFULL);
+    nf -> mem = TRUE;
+    if (!(nf -> text = (char *)malloc(len ? len : 1))) {
+		free(nf);  fatal_error(MEMFULL);
+    }
+    memcpy(nf -> text,text,nf -> len = len);
+    slocked();
+    for (sf = sfiles; sf; sf = sf -> next)
+		if (!sf -> stale && sf -> mem && !strcmp(sf -> sname,nam)) { sdrop(sf);  break; }
+    nf -> next = sfiles;  sfiles = nf;
+    sunlocked();
+    return;
+}
+
+/*  Empty the cache.  Entries still in use go once they're done with.	*/
+
+void a65n_forget() {
+    SCRATCH SRCFILE *sf, *next;
+
+    slocked();
+    for (sf = sfiles; sf; sf = next) {
+		next = sf -> next;
+		if (!sf -> stale) sdrop(sf);
+    }
+    sunlocked();
+    return;
+}
+
+/*  Include file reader start-up routine.  The reader goes through	*/
+/*  source sf on a thread of its own until endutil() stops it.  If the	*/
+/*  thread can't be had, the files are read as the assembly gets to	*/
+/*  them.								*/
+
+void sreadahead(SRCFILE *sf) {
+#ifndef __STDC_NO_THREADS__
+    SCRATCH READER *r;
+
+    if (reader || !(r = (READER *)calloc(1,sizeof(READER)))) return;
+    r -> sf = sf;  strcpy(r -> basedir,basedir);
+    slocked();  ++sf -> users;  sunlocked();
+    if (thrd_create(&rthread,readahead,r) != thrd_success) {
+		srelease(sf);  free(r);  return;
+    }
+    reader = r;
+#endif
+    return;
+}
+
+#ifndef __STDC_NO_THREADS__
+
+/*  Include file reader thread.						*/
+
+static int readahead(void *arg) {
+    SCRATCH READER *r;
+
+    r = (READER *)arg;
+    rscan(r,r -> sf,0);
+    srelease(r -> sf);
+    return 0;
+}
+
+/*  Picks the INCL and INCB statements out of the text of entry sf the	*/
+/*  way the line assembler would, and reads the files they name, and	*/
+/*  the snapshots of INCL files, into the cache.  It recurses (as far	*/
+/*  as the line assembler nests INCL files), so no SCRATCH here.	*/
+
+static void rscan(READER *r, SRCFILE *sf, unsigned depth) {
+    char *p, *q, *s, *end, op[6], nam[MAXLINE * 2 + sizeof(SNAPEXT)];
+    int binary, stop;
+    unsigned n;
+    SRCFILE *f;
+
+    for (p = sf -> text, end = p + sf -> len; p < end; p = q + 1) {
+		if (!(q = (char *)memchr(p,'\n',end - p))) q = end;
+		if (*p == ';') continue;
+		while (p < q && *p != ' ' && *p != '\t') ++p;
+		while (p < q && (*p == ' ' || *p == '\t')) ++p;
+		for (n = 0; n < 5 && p < q && *p != ' ' && *p != '\t'; op[n++] = toupper(*p++ & 0377));
+		op[n] = '\0';
+		if (strcmp(op,"INCL") && strcmp(op,"INCB")) continue;
+		binary = op[3] == 'B';
+
+		while (p < q && (*p == ' ' || *p == '\t')) ++p;
+		if (p == q || (*p != '"' && *p != '\'')) continue;
+		for (s = p + 1; s < q && *s != *p; ++s);
+		if (s == q || s - p > MAXLINE) continue;
+		n = sprintf(nam,"%s%s%.*s",r -> basedir,*r -> basedir ? "/" : "",
+			(int)(s - p - 1),p + 1);
+
+		slocked();  stop = r -> stop;  sunlocked();
+		if (stop) return;
+		if (!binary) {
+			strcpy(nam + n,SNAPEXT);
+			if ((f = rfetch(nam,TRUE))) srelease(f);
+			nam[n] = '\0';
+		}
+		if (!(f = rfetch(nam,binary))) continue;
+		if (!binary && depth + 1 < FILES) rscan(r,f,depth + 1);
+		srelease(f);
+    }
+    return;
+}
+
+/*  Reads the named file into the cache, if it isn't there already and	*/
+/*  no other reader has it in hand.  Returns the entry, with a use	*/
+/*  counted, or NULL if there's none to be had.  Nothing that goes	*/
+/*  wrong here is an error:  sopen() will find it out in its turn.	*/
+
+static SRCFILE *rfetch(char *nam, int binary) {
+    SCRATCH SRCFILE *sf, *nf, **p;
+    SCRATCH char *path;
+    SCRATCH int ok;
+    struct stat st;
+    FILE *fp;
+
+    if (!(path = realpath(nam,NULL))) return NULL;
+    nf = snew(nam,path,binary);  free(path);
+    if (!nf) return NULL;
+    slocked();
+    sf = sfind(nam,nf -> path,binary);
+    if (sf && (sf -> mem || (!stat(nam,&st) && sf -> size == (long long)st.st_size &&
+		sf -> mtime == mtimeof(st)))) {
+		++sf -> users;  sunlocked();
+		free(nf);  return sf;
+    }
+    if (sbusied(nf -> path,binary)) { sunlocked();  free(nf);  return NULL; }
+    nf -> next = sbusy;  sbusy = nf;
+    sunlocked();
+
+    ok = !stat(nam,&st) && (fp = fopen(nam, binary ? "rb" : "r"));
+    if (ok) {
+		nf -> size = st.st_size;  nf -> mtime = mtimeof(st);
+		ok = !sread(nf,fp);
+    }
+
+    slocked();
+    for (p = &sbusy; *p != nf; p = &((*p) -> next));
+    *p = nf -> next;
+    sf = ok ? sadd(nf) : NULL;
+    cnd_broadcast(&sready);
+    sunlocked();
+    if (!ok) { free(nf -> text);  free(nf); }
+    return sf;
+}
+
+/*  Gives back a use of entry sf.					*/
+
+static void srelease(SRCFILE *sf) {
+    slocked();
+    if (!--sf -> users && sf -> stale) sdrop(sf);
+    sunlocked();
+    return;
+}
+
+#endif
+
+/*  Hands over the names of the files this assembly has read, each	*/
+/*  ending with a \0, setting *len to their length.  Files handed over	*/
+/*  in memory aren't counted.  The caller frees them.  Returns NULL if	*/
+/*  there's no room for them.						*/
+
+char *sdeps(size_t *len) {
+    SCRATCH char *p, *q;
+    SCRATCH unsigned i;
+
+    for (*len = i = 0; i < nseen; ++i)
+		if (!sseen[i] -> mem) *len += strlen(sseen[i] -> sname) + 1;
+    if (!(p = q = (char *)malloc(*len ? *len : 1))) { *len = 0;  return NULL; }
+    for (i = 0; i < nseen; ++i)
+		if (!sseen[i] -> mem) q += strlen(strcpy(q,sseen[i] -> sname)) + 1;
+    return p;
+}
+
+/*  Hands over the names of the files this assembly asked for that	*/
+/*  weren't there, each ending with a \0, setting *len to their length.	*/
+/*  Returns NULL if there were none.  The caller frees them.		*/
+
+char *smissing(size_t *len) {
+    SCRATCH char *p;
+
+    p = smiss;  *len = nmiss;
+    smiss = NULL;  nmiss = misssize = 0;
+    return p;
+}
+
+/*  Dependency file routine.  The rule names the output files as its	*/
+/*  targets (the source if there are none) and every file read from	*/
+/*  disk as a prerequisite, and each prerequisite gets an empty rule of	*/
+/*  its own so that make doesn't stop when one of them is removed.	*/
+
+void dwrite(char *nam) {
+    SCRATCH FILE *fp;
+    SCRATCH unsigned i;
+    SCRATCH int n;
+    char *tmp, *out[3];
+
+    if (!(fp = create(nam,"w",&tmp,ctx -> atomic))) fatal_error(DEPOPEN);
+    out[0] = ctx -> object;  out[1] = ctx -> listing;  out[2] = ctx -> export;
+    if (!out[0] && !out[1] && !out[2]) out[0] = ctx -> source;
+    for (n = FALSE, i = 0; i < 3; ++i)
+		if (out[i]) { if (n) putc(' ',fp);  dname(fp,out[i]);  n = TRUE; }
+    putc(':',fp);
+    for (i = 0; i < nseen; ++i)
+		if (!sseen[i] -> mem) { fputs(" \\\n ",fp);  dname(fp,sseen[i] -> sname); }
+    putc('\n',fp);
+    for (i = 0; i < nseen; ++i)
+		if (!sseen[i] -> mem) { putc('\n',fp);  dname(fp,sseen[i] -> sname);  fputs(":\n",fp); }
+    if (commit(fp,nam,&tmp)) fatal_error(DSKFULL);
+    return;
+}
+
+/*  Writes a file name the way make and ninja read it.			*/
+
+static void dname(FILE *fp, char *nam) {
+    for (; *nam; ++nam) {
+		if (*nam == '$') putc('$',fp);
+		else if (*nam == ' ' || *nam == '\t' || *nam == '#') putc('\\',fp);
+		putc(*nam,fp);
+    }
+    return;
+}
+
+/*  Symbol snapshots.  A header of equates can be assembled once into	*/
+/*  a snapshot of the global symbols it defines, kept beside it under	*/
+/*  its name with SNAPEXT added.  An INCL of the header then defines	*/
+/*  the symbols straight from the snapshot instead of reading the	*/
+/*  header, as long as the snapshot was made from the header, and the	*/
+/*  files it includes, as they are now.  A snapshot is SNAPMAGIC, the	*/
+/*  hash of the header's text, and the number of files the header read	*/
+/*  in four bytes, low byte first, then for each file the hash of its	*/
+/*  text, 'b' or 't' for an INCB or INCL file, the length of its name	*/
+/*  (two bytes, low byte first), and its name.  Then comes the number	*/
+/*  of symbols in four bytes, low byte first, and for each symbol its	*/
+/*  value (two bytes, low byte first), SNAPSOFT if it was defined by	*/
+/*  SET, the length of its name, and its name.  It is read through the	*/
+/*  source file cache, so it stays in memory from one assembly to the	*/
+/*  next just as the header would.					*/
+
+/*  Snapshot include routine.  Returns TRUE if the symbols of the	*/
+/*  header nam were taken from its snapshot.  In pass 1 they are	*/
+/*  defined as EQU and SET would define them; in pass 2 they are	*/
+/*  checked and marked as seen, so that uses of them after the INCL	*/
+/*  aren't taken for forward references.  The files the header read	*/
+/*  are opened to check them, so they count as read by this assembly.	*/
+
+int sload(char *nam) {
+    SCRATCH SRCFILE *sp, *sf;
+    SCRATCH unsigned char *p, *end, *syms;
+    SCRATCH unsigned long n, i;
+    SCRATCH unsigned valu, soft, len;
+    SCRATCH SYMBOL *l;
+    unsigned char sum[HASHSIZE];
+    char snam[MAXLINE * 2 + sizeof(SNAPEXT)], sym[MAXLINE + 1];
+
+    strcat(strcpy(snam,nam),SNAPEXT);
+    if (!(sp = sopen(snam,TRUE)) || !(sf = sopen(nam,FALSE))) return FALSE;
+    p = (unsigned char *)sp -> text;  end = p + sp -> len;
+    if (sp -> len < SNAPHEAD || memcmp(p,SNAPMAGIC,8)) {
+		if (lastpass) warning(BADSNAP);
+		return FALSE;
+    }
+    shash(sf,sum);
+    if (memcmp(p + 8,sum,HASHSIZE)) {
+		if (lastpass) warning(OLDSNAP);
+		return FALSE;
+    }
+    p += 8 + HASHSIZE;
+    n = p[0] | p[1] << 8 | (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24;
+    for (p += 4, i = 0; i < n; ++i, p += HASHSIZE + 3 + len) {
+		if (end - p < HASHSIZE + 3 ||
+			(len = p[HASHSIZE + 1] | p[HASHSIZE + 2] << 8) >= sizeof(snam) ||
+			end - p < HASHSIZE + 3 + len) {
+			if (lastpass) warning(BADSNAP);
+			return FALSE;
+		}
+		memcpy(snam,p + HASHSIZE + 3,len);  snam[len] = '\0';
+		if ((sf = sopen(snam,p[HASHSIZE] == 'b'))) shash(sf,sum);
+		if (!sf || memcmp(p,sum,HASHSIZE)) {
+			if (lastpass) warning(OLDSNAP);
+			return FALSE;
+		}
+    }
+    if (end - p < 4) {
+		if (lastpass) warning(BADSNAP);
+		return FALSE;
+    }
+    n = p[0] | p[1] << 8 | (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24;
+    for (syms = p += 4, i = 0; i < n; ++i, p += 4 + p[3])
+		if (end - p < 4 || end - p < 4 + p[3] || !p[3]) {
+			if (lastpass) warning(BADSNAP);
+			return FALSE;
+		}
+
+    for (p = syms, i = 0; i < n; ++i, p += 4 + p[3]) {
+		valu = p[0] | p[1] << 8;  soft = p[2] & SNAPSOFT ? SOFT : 0;
+		memcpy(sym,p + 4,p[3]);  sym[p[3]] = '\0';
+		if (pass == 1) {
+			if (!((l = new_symbol(sym)) -> attr) || (soft && l -> attr & SOFT)) {
+				l -> attr = FORWD + soft + VAL;  l -> valu = valu;
+				settle(l);
+			}
+			else if (onepass) error('M');
+		}
+		else if (!(l = find_symbol(sym))) error('P');
+		else if (soft && l -> attr & SOFT) { l -> attr = SOFT + VAL;  l -> valu = valu; }
+		else {
+			l -> attr = VAL;
+			if (l -> valu != valu) error('M');
+		}
+    }
+    return TRUE;
+}
+
+/*  Snapshot write routine.  Writes the global symbols the assembly	*/
+/*  defined to the snapshot of the main source.  If the file doesn't	*/
+/*  open correctly, a fatal error occurs.				*/
+
+void swrite() {
+    SCRATCH FILE *fp;
+    SCRATCH SYMBOL *l;
+    SCRATCH unsigned i, n;
+    char *tmp, *snam;
+    unsigned char head[8 + HASHSIZE];
+
+    if (!(snam = (char *)malloc(strlen(ctx -> source) + sizeof(SNAPEXT)))) fatal_error(MEMFULL);
+    strcat(strcpy(snam,ctx -> source),SNAPEXT);
+    if (!(fp = create(snam,"wb",&tmp,TRUE))) { free(snam);  fatal_error(SNPOPEN); }
+
+    memcpy(head,SNAPMAGIC,8);
+    shash(sseen[0],head + 8);
+    fwrite(head,1,8 + HASHSIZE,fp);
+    sput4(fp,nseen - 1);
+    for (i = 1; i < nseen; ++i) {
+		shash(sseen[i],head);  fwrite(head,1,HASHSIZE,fp);
+		putc(sseen[i] -> binary ? 'b' : 't',fp);
+		putc((n = strlen(sseen[i] -> sname)) & 0xff,fp);  putc(n >> 8,fp);
+		fwrite(sseen[i] -> sname,1,n,fp);
+    }
+    for (n = i = 0; i < globals.size; ++i)
+		if ((l = globals.slot[i].sym) && l -> attr) ++n;
+    sput4(fp,n);
+    for (i = 0; i < globals.size; ++i)
+		if ((l = globals.slot[i].sym) && l -> attr) {
+			putc(l -> valu & 0xff,fp);  putc(l -> valu >> 8 & 0xff,fp);
+			putc(l -> attr & SOFT ? SNAPSOFT : 0,fp);
+			putc(n = strlen(l -> sname),fp);  fwrite(l -> sname,1,n,fp);
+		}
+    n = commit(fp,snam,&tmp);
+    free(snam);
+    if (n) fatal_error(DSKFULL);
+    return;
+}
+
+/*  Writes n in four bytes, low byte first.				*/
+
+static void sput4(FILE *fp, unsigned long n) {
+    putc(n & 0xff,fp);  putc(n >> 8 & 0xff,fp);
+    putc(n >> 16 & 0xff,fp);  putc(n >> 24 & 0xff,fp);
+    return;
+}
+
+/*  Output cache.  An assembly whose context names a cache directory	*/
+/*  looks there before it runs.  Its key is a hash of the options and	*/
+/*  the source name, and under the key the cache keeps a list of the	*/
+/*  files the last such assembly read, with a hash of each.  If every	*/
+/*  file still hashes the same, the outputs the assembly made are in	*/
+/*  the cache under a hash of the key and the list, and are copied out	*/
+/*  instead of assembling.  Otherwise the assembly runs and, if it had	*/
+/*  no errors, leaves its list and outputs behind for the next one.	*/
+/*  The object image, the listing, the export file, and the messages	*/
+/*  are kept in files named for that hash, ending in .o, .l, .e, and	*/
+/*  .m.									*/
+
+#define	HEXHASH		(HASHSIZE * 2 + 1)
+
+static THREAD char ckey[HEXHASH], cid[HEXHASH];
+static THREAD char *heard = NULL;
+static THREAD size_t nheard = 0;
+
+/*  Cache look-up routine.  Returns TRUE if the outputs were found and	*/
+/*  put in place, with the object image held for btake() if the	*/
+/*  context wants it.  The files checked stay open for the assembly	*/
+/*  that runs if they weren't.						*/
+
+int cfetch() {
+    SCRATCH SRCFILE *sf;
+    SCRATCH char *p, *q;
+    SCRATCH size_t n;
+    HASH h;
+    char *list, nam[HEXHASH];
+    size_t len;
+    unsigned char sum[HASHSIZE];
+
+    hinit(&h);
+    hadd(&h,"a65n 1",7);
+    hadd(&h,ctx -> source,strlen(ctx -> source) + 1);
+    p = ctx -> basedir ? ctx -> basedir : "";  hadd(&h,p,strlen(p) + 1);
+    p = ctx -> epoch ? ctx -> epoch : "";  hadd(&h,p,strlen(p) + 1);
+    hadd(&h,ctx -> onepass ? "s" : "",ctx -> onepass ? 2 : 1);
+    hadd(&h,ctx -> listing ? "l" : "",ctx -> listing ? 2 : 1);
+    hadd(&h,ctx -> export ? "e" : "",ctx -> export ? 2 : 1);
+    hadd(&h,ctx -> relocate ? "r" : "",ctx -> relocate ? 2 : 1);
+    hdone(&h,sum);  hexhash(ckey,sum);
+    cid[0] = '\0';  free(heard);  heard = NULL;  nheard = 0;
+
+    if (!(list = cload(ckey,".d",&len))) return FALSE;
+    for (p = list; p < list + len; p = q + 1) {
+		if (!(q = memchr(p,'\n',list + len - p)) || q - p < HEXHASH + 3) {
+			free(list);  return FALSE;
+		}
+		*q = '\0';
+		if (!(sf = sopen(p + HEXHASH + 2,p[HEXHASH] == 'b'))) { free(list);  return FALSE; }
+		shash(sf,sum);  hexhash(nam,sum);
+		if (memcmp(nam,p,HEXHASH - 1)) { free(list);  return FALSE; }
+		*q = '\n';
+    }
+    hinit(&h);  hadd(&h,ckey,HEXHASH);  hadd(&h,list,len);  hdone(&h,sum);
+    free(list);
+    hexhash(nam,sum);
+
+    if (!(p = cload(nam,".o",&n))) return FALSE;
+    q = NULL;
+    if ((ctx -> listing && !(q = cload(nam,".l",&len))) ||
+		(ctx -> object && cput(ctx -> object,p,n)) ||
+		(ctx -> listing && cput(ctx -> listing,q,len))) { free(p);  free(q);  return FALSE; }
+    free(q);  q = NULL;
+    if (ctx -> export && (!(q = cload(nam,".e",&len)) || cput(ctx -> export,q,len))) {
+		free(p);  free(q);  return FALSE;
+    }
+    free(q);
+    if (ctx -> keepimage) { image = (uint8_t *)p;  imgsize = addr = n; }
+    else free(p);
+    if ((q = cload(nam,".m",&len))) {
+		if (len) say(FALSE,"%.*s",(int)len,q);
+		free(q);
+    }
+    return TRUE;
+}
+
+/*  Cache store routine.  Keeps the outputs of the assembly that just	*/
+/*  finished under the key cfetch() worked out.  The cache is only a	*/
+/*  help, so files that can't be written are quietly left out.		*/
+
+void cstore() {
+    SCRATCH unsigned i;
+    SCRATCH char *p;
+    HASH h;
+    char *list, nam[HEXHASH];
+    size_t len;
+    unsigned char sum[HASHSIZE];
+
+    for (len = i = 0; i < nseen; ++i) len += HEXHASH + 3 + strlen(sseen[i] -> sname);
+    if (!(list = p = (char *)malloc(len + 1))) return;
+    for (i = 0; i < nseen; ++i) {
+		shash(sseen[i],sum);  hexhash(nam,sum);
+		p += sprintf(p,"%s %c %s\n",nam,sseen[i] -> binary ? 'b' : 't',sseen[i] -> sname);
+    }
+    len = p - list;
+    hinit(&h);  hadd(&h,ckey,HEXHASH);  hadd(&h,list,len);  hdone(&h,sum);
+    hexhash(cid,sum);
+
+    mkdir(ctx -> cache,0777);
+    if (!csave(cid,".o",(char *)image,addr) &&
+		(!ctx -> listing || !ccopy(ctx -> listing,".l")) &&
+		(!ctx -> export || !ccopy(ctx -> export,".e")) &&
+		!csave(cid,".m",heard,nheard)) csave(ckey,".d",list,len);
+    free(list);
+    return;
+}
+
+/*  Keeps what the assembly says on its out stream, for cstore().	*/
+
+static void hear(char *fmt, va_list ap) {
+    SCRATCH char *p;
+    SCRATCH int n;
+    va_list aq;
+
+    va_copy(aq,ap);
+    n = vsnprintf(NULL,0,fmt,aq);
+    va_end(aq);
+    if (n > 0 && (p = (char *)realloc(heard,nheard + n + 1))) {
+		heard = p;
+		vsnprintf(p + nheard,n + 1,fmt,ap);
+		nheard += n;
+    }
+    return;
+}
+
+/*  Reads cache file id followed by extension ext.  Returns its	*/
+/*  contents (malloc'ed), setting *len to their length, or NULL if it	*/
+/*  can't be read.							*/
+
+static char *cload(char *id, char *ext, size_t *len) {
+    SCRATCH FILE *fp;
+    SCRATCH char *p, *q;
+    SCRATCH size_t n, size;
+    char nam[MAXLINE * 4];
+
+    snprintf(nam,sizeof(nam),"%s/%s%s",ctx -> cache,id,ext);
+    if (!(fp = fopen(nam,"rb"))) return NULL;
+    p = NULL;  *len = size = 0;
+    do {
+		if (*len == size) {
+			size = size ? size * 2 : HEXSIZE;
+			if (!(q = (char *)realloc(p,size))) { free(p);  fclose(fp);  return NULL; }
+			p = q;
+		}
+		n = fread(p + *len,1,size - *len,fp);
+		*len += n;
+    } while (n);
+    if (ferror(fp)) { free(p);  p = NULL; }
+    fclose(fp);
+    return p;
+}
+
+/*  Writes n bytes from p to cache file id followed by extension ext.	*/
+/*  Returns non-zero if they can't be written.				*/
+
+static int csave(char *id, char *ext, char *p, size_t n) {
+    SCRATCH FILE *fp;
+    char nam[MAXLINE * 4], *tmp;
+
+    snprintf(nam,sizeof(nam),"%s/%s%s",ctx -> cache,id,ext);
+    if (!(fp = create(nam,"wb",&tmp,TRUE))) return -1;
+    if (n) fwrite(p,1,n,fp);
+    return commit(fp,nam,&tmp);
+}
+
+/*  Copies output file nam into the cache under the extension ext.	*/
+/*  Returns non-zero if it can't be copied.				*/
+
+static int ccopy(char *nam, char *ext) {
+    SCRATCH FILE *fp;
+    SCRATCH char *p, *q;
+    SCRATCH size_t n, len, size;
+    SCRATCH int r;
+
+    if (!(fp = fopen(nam,"rb"))) return -1;
+    p = NULL;  len = size = 0;
+    do {
+		if (len == size) {
+			size = size ? size * 2 : HEXSIZE;
+			if (!(q = (char *)realloc(p,size))) { free(p);  fclose(fp);  return -1; }
+			p = q;
+		}
+		n = fread(p + len,1,size - len,fp);
+		len += n;
+    } while (n);
+    r = ferror(fp) ? -1 : csave(cid,ext,p,len);
+    fclose(fp);  free(p);
+    return r;
+}
+
+/*  Puts n bytes from p in place as output file nam.  Returns non-zero	*/
+/*  if they can't be written.						*/
+
+static int cput(char *nam, char *p, size_t n) {
+    SCRATCH FILE *fp;
+    char *tmp;
+
+    if (!(fp = create(nam,"wb",&tmp,ctx -> atomic))) return -1;
+    if (n) fwrite(p,1,n,fp);
+    return commit(fp,nam,&tmp);
+}
+
+/*  Writes hash sum as hex digits to string s.				*/
+
+static void hexhash(char *s, unsigned char *sum) {
+    SCRATCH unsigned i;
+
+    for (i = 0; i < HASHSIZE; ++i) sprintf(s + 2 * i,"%02x",sum[i]);
+    return;
+}
+
+/*  SHA-256, as the cache's hash.					*/
+
+static const unsigned long hk[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define	ROR(x,n)	((((x) >> (n)) | ((x) << (32 - (n)))) & 0xffffffff)
+
+static void hinit(HASH *h) {
+    static const unsigned long h0[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    memcpy(h -> h,h0,sizeof(h0));  h -> n = 0;
+    return;
+}
+
+static void hadd(HASH *h, const void *p, size_t n) {
+    const unsigned char *s;
+    unsigned k;
+
+    for (s = (const unsigned char *)p; n; n -= k, s += k) {
+		k = h -> n % 64;
+		if ((k = 64 - k) > n) k = n;
+		memcpy(h -> buf + h -> n % 64,s,k);
+		if ((h -> n += k) % 64 == 0) hblock(h);
+    }
+    return;
+}
+
+static void hdone(HASH *h, unsigned char *sum) {
+    SCRATCH unsigned i;
+    SCRATCH unsigned long long bits;
+    unsigned char pad[72];
+
+    bits = h -> n * 8;
+    memset(pad,0,sizeof(pad));  pad[0] = 0x80;
+    i = (h -> n % 64 < 56 ? 56 : 120) - h -> n % 64;
+    hadd(h,pad,i);
+    for (i = 0; i < 8; ++i) pad[i] = bits >> (56 - 8 * i);
+    hadd(h,pad,8);
+    for (i = 0; i < HASHSIZE; ++i) sum[i] = h -> h[i / 4] >> (24 - 8 * (i % 4));
+    return;
+}
+
+static void hblock(HASH *h) {
+    SCRATCH unsigned i;
+    SCRATCH unsigned long a, b, c, d, e, f, g, k, t, u;
+    unsigned long w[64];
+
+    for (i = 0; i < 16; ++i)
+		w[i] = (unsigned long)h -> buf[4 * i] << 24 | (unsigned long)h -> buf[4 * i + 1] << 16 |
+			(unsigned long)h -> buf[4 * i + 2] << 8 | h -> buf[4 * i + 3];
+    for (; i < 64; ++i) {
+		t = ROR(w[i - 15],7) ^ ROR(w[i - 15],18) ^ (w[i - 15] >> 3);
+		u = ROR(w[i - 2],17) ^ ROR(w[i - 2],19) ^ (w[i - 2] >> 10);
+		w[i] = (w[i - 16] + t + w[i - 7] + u) & 0xffffffff;
+    }
+    a = h -> h[0];  b = h -> h[1];  c = h -> h[2];  d = h -> h[3];
+    e = h -> h[4];  f = h -> h[5];  g = h -> h[6];  k = h -> h[7];
+    for (i = 0; i < 64; ++i) {
+		t = k + (ROR(e,6) ^ ROR(e,11) ^ ROR(e,25)) + ((e & f) ^ (~e & g)) + hk[i] + w[i];
+		u = (ROR(a,2) ^ ROR(a,13) ^ ROR(a,22)) + ((a & b) ^ (a & c) ^ (b & c));
+		k = g;  g = f;  f = e;  e = (d + t) & 0xffffffff;
+		d = c;  c = b;  b = a;  a = (t + u) & 0xffffffff;
+    }
+    h -> h[0] = (h -> h[0] + a) & 0xffffffff;  h -> h[1] = (h -> h[1] + b) & 0xffffffff;
+    h -> h[2] = (h -> h[2] + c) & 0xffffffff;  h -> h[3] = (h -> h[3] + d) & 0xffffffff;
+    h -> h[4] = (h -> h[4] + e) & 0xffffffff;  h -> h[5] = (h -> h[5] + f) & 0xffffffff;
+    h -> h[6] = (h -> h[6] + g) & 0xffffffff;  h -> h[7] = (h -> h[7] + k) & 0xffffffff;
+    return;
+}
+
+/*  Utility package clean-up routine.  Everything the assembly used	*/
+/*  but the source file cache is given back, any files still open are	*/
+/*  closed, and the package is set up for the next assembly.		*/
+
+void endutil() {
+    SCRATCH void *p;
+    SCRATCH unsigned i;
+
+    if (export) scrap(export,&etmp);
+    if (lw) { lstop();  free(lw);  lw = NULL; }
+    if (list) scrap(list,&ltmp);
+    if (outfile) scrap(outfile,&btmp);
+    export = list = outfile = NULL;
+    free_scope(&globals);
+    while ((p = arenas)) { arenas = *(void **)p;  free(p); }
+    arenap = NULL;  arenaleft = 0;
+    curscope = NULL;  curglob = NULL;  curdot = FALSE;  nsyms = 0;
+    free(lrecs);  lrecs = NULL;  lheld = FALSE;  lcnt = lsize = 0;
+    ltitle = NULL;  col = 0;
+    free(lkrows);  lkrows = NULL;  lkeeping = FALSE;  lklen = lksize = 0;
+    free(image);  image = NULL;  imgsize = 0;
+    bheld = FALSE;  cnt = 0;  addr = 0;
+    rclear();
+    free(rbases);  rbases = NULL;  basesize = 0;
+    free(rexps);  rexps = NULL;  nrexps = rexpsize = 0;
+    free(prefs);  prefs = NULL;  nprefs = prefsize = 0;
+    free(plive);  plive = NULL;  nprocs = 0;  pdone = FALSE;
+#ifndef __STDC_NO_THREADS__
+    if (reader) {
+		slocked();  reader -> stop = TRUE;  sunlocked();
+		thrd_join(rthread,NULL);  free(reader);  reader = NULL;
+    }
+#endif
+    slocked();
+    for (i = 0; i < nseen; ++i)
+		if (!--sseen[i] -> users && sseen[i] -> stale) sdrop(sseen[i]);
+    sunlocked();
+    free(sseen);  sseen = NULL;  nseen = seensize = 0;
+    free(smiss);  smiss = NULL;  nmiss = misssize = 0;
+    free(heard);  heard = NULL;  nheard = 0;
+    return;
+}
+
+/*  Frees the slot arrays of table sc and its scopes.  It recurses, so	*/
+/*  no SCRATCH here.  The scopes themselves live in the arena.		*/
+
+static void free_scope(SCOPE *sc) {
+    unsigned i;
+
+    for (i = 0; i < sc -> size; ++i)
+		if (sc -> slot[i].scope) free_scope(sc -> slot[i].scope);
+    free(sc -> slot);
+    sc -> slot = NULL;  sc -> size = sc -> count = 0;
+    return;
+}
+
+/*  Message output routine.  Error lines (err set) go to the context's	*/
+/*  err stream, other messages to its out stream.  If the stream is	*/
+/*  NULL, the message is added to the context's diag buffer instead.	*/
+
+void say(int err, char *fmt, ...) {
+    SCRATCH FILE *fp;
+    SCRATCH int n;
+    SCRATCH char *p;
+    va_list ap;
+
+    fp = !ctx ? (err ? stderr : stdout) : err ? ctx -> err : ctx -> out;
+    va_start(ap,fmt);
+    if (ctx && ctx -> cache && !err) {
+		va_list aq;
+
+		va_copy(aq,ap);  hear(fmt,aq);  va_end(aq);
+    }
+    if (fp) vfprintf(fp,fmt,ap);
+    else {
+		va_list aq;
+
+		va_copy(aq,ap);
+		n = vsnprintf(NULL,0,fmt,aq);
+		va_end(aq);
+		if (n > 0) {
+			if (!(p = (char *)realloc(ctx -> diag,ctx -> diaglen + n + 1))) {
+				va_end(ap);  return;
+			}
+			ctx -> diag = p;
+			vsnprintf(p + ctx -> diaglen,n + 1,fmt,ap);
+			ctx -> diaglen += n;
+		}
+    }
+    va_end(ap);
+    return;
+}
+
 /*  Error handler routine.  If the current error code is non-blank,	*/
 /*  the error code is filled in and the	number of lines with errors	*/
 /*  is adjusted.							*/
@@ -416,7 +2571,7 @@ void error(char code) {
     if (errcode == ' ') {
 		errcode = code;
 		++errors;
-		if (pass == 2) {
+		if (lastpass) {
 			switch (code) {
 			case '*':	description = ERR_STATEMENT;	break;
 			case '(':	description = ERR_PAREN;		break;
@@ -428,6 +2583,7 @@ void error(char code) {
 			case 'I':	description = ERR_I;			break;
 			case 'L':	description = ERR_L;			break;
 			case 'M':	description = ERR_M;			break;
+			case 'N':	description = ERR_N;			break;
 			case 'O':	description = ERR_O;			break;
 			case 'P':	description = ERR_P;			break;
 			case 'R':	description = ERR_R;			break;
@@ -435,27 +2591,41 @@ void error(char code) {
 			case 'T':	description = ERR_T;			break;
 			case 'U':	description = ERR_U;			break;
 			case 'V':	description = ERR_V;			break;
+			case 'X':	description = ERR_X;			break;
 			default:	description = ERR_UNKNOWN;		break;
 			}
 
-			fprintf(stderr, "%s:%d: %c -- %s\n", filestk[filesp].filename, filestk[filesp].linenum, code, description);
+			say(TRUE, "%s:%d: %c -- %s\n", filestk[filesp].filename, filestk[filesp].linenum, code, description);
 		}
 	}
     return;
 }
 
-/*  Fatal error handler routine.  A message gets printed on the stderr	*/
-/*  device, and the program bombs.					*/
+/*  Fatal error handler routine.  A message gets printed on the stdout	*/
+/*  device, and the assembly bombs back to a65n_assemble().  A message	*/
+/*  kept for later (see A65CTX) is marked with the source's name.	*/
 
 void fatal_error(char *msg) {
-    printf("Fatal Error -- %s\n",msg);
+    if (ctx && !ctx -> out && ctx -> source)
+		say(FALSE,"%s: Fatal Error -- %s\n",ctx -> source,msg);
+    else say(FALSE,"Fatal Error -- %s\n",msg);
+    if (ctx) ctx -> fatal = msg;
+    if (bailout) longjmp(*bailout,1);
     exit(-1);
 }
 
+/*  Gives the line a pass 2 worker is on back to the main thread (see	*/
+/*  RUNREC in A65.H):  the worker bombs back to where it started the	*/
+/*  line, with no message.						*/
+
+void handback() {
+    longjmp(*bailout,1);
+}
+
 /*  Non-fatal error handler routine.  A message gets printed on the	*/
-/*  stderr device, and the routine returns.				*/
+/*  stdout device, and the routine returns.				*/
 
 void warning(char *msg) {
-    printf("Warning -- %s\n",msg);
+    say(FALSE,"Warning -- %s\n",msg);
     return;
 }
@@ -11,13 +11,21 @@ utility packages:
 
 	1)  symbol table building and searching
 
-	2)  opcode and operator table searching
+	2)  dead code elimination
 
-	3)  listing file output
+	3)  opcode and operator table searching
 
-	4)  hex file output
+	4)  listing file output
 
-	5)  error flagging
+	5)  hex file output
+
+	6)  relocatable object output
+
+	7)  source file caching
+
+	8)  output caching
+
+	9)  error flagging
 */
 
 #include "a65.h"
@@ -33,6 +41,7 @@ utility packages:
 #define ERR_I			"IF-ENDI imbalance"
 #define ERR_L			"Illegal label"
 #define ERR_M			"Multiply defined label"
+#define ERR_N			"PROC-ENDPROC imbalance"
 #define ERR_O			"Illegal opcode"
 #define ERR_P			"Phasing error"
 #define ERR_R			"Illegal register"
@@ -40,6 +49,7 @@ utility packages:
 #define ERR_T			"Too many arguments"
 #define ERR_U			"Undefined label"
 #define ERR_V			"Illegal value"
+#define ERR_X			"Illegal relocation"
 #define ERR_UNKNOWN		"Unknown error"
 
 /*  Add new symbol to symbol table.  Returns pointer to symbol even if	*/
@@ -50,14 +60,79 @@ SYMBOL *new_symbol(char *nam);
 
 
 /*  Look up symbol in symbol table.  Returns pointer to symbol or NULL	*/
-/*  if symbol not found.												*/
+/*  if symbol not found.  Symbols that new_symbol() made for the token	*/
+/*  cache but that were never defined are not found.					*/
 
 SYMBOL *find_symbol(char *nam);
 
 
+/*  Same as new_symbol() and find_symbol(), but for the local label		*/
+/*  nam in the scope of the global label glob, which must be an			*/
+/*  interned string.  The symbol's full name is glob followed by nam.	*/
+
+SYMBOL *new_local(char *glob, char *nam);
+SYMBOL *find_local(char *glob, char *nam);
+
+
+/*  String interning routine.  Returns the one stored copy of the		*/
+/*  string, adding it to the table if need be.							*/
+
+char *intern(char *nam);
+
+
+/*  Memory arena allocation routine.  Returns n bytes of zeroed memory	*/
+/*  that lasts until the end of the assembly.  If there's not enough	*/
+/*  memory, a fatal error occurs.										*/
+
+void *arena(size_t n);
+
+
+/*  Numbers a new PROC block for pass 1.  Returns 0 once prune() has	*/
+/*  run, as there are no more blocks to be had.				*/
+
+unsigned pnew();
+
+
+/*  Records a reference to sym from the PROC block inproc (see A65.C)	*/
+/*  for prune() to follow.  References made after prune() are ignored.	*/
+
+void refer(SYMBOL *sym);
+
+
+/*  Works out, once pass 1 is done, which PROC blocks can be reached	*/
+/*  from the code outside them.  Returns TRUE if any can't be (so pass	*/
+/*  1 must be run again without them), FALSE otherwise or if it has	*/
+/*  already run.							*/
+
+int prune();
+
+
+/*  Tells whether PROC block n is kept, or whether sym was defined in a	*/
+/*  block that was dropped.						*/
+
+int live(unsigned n);
+int dropped(SYMBOL *sym);
+
+
+/*  Forgets the value of every label, and the relocatable sections and	*/
+/*  imports, so that pass 1 can be run again.				*/
+
+void forget();
+
+
+/*  Symbol table lending routines.  symlend() hands over the symbol		*/
+/*  table and PROC blocks, and symborrow() lets a pass 2 worker thread	*/
+/*  look labels up in them.  The worker never adds to them, and never	*/
+/*  gives them back.													*/
+
+void symlend(SYMTAB *t);
+void symborrow(SYMTAB *t);
+
+
 /*  Opcode table search routine.  This routine pats down the opcode		*/
 /*  table for a given opcode and returns either a pointer to it or		*/
-/*  NULL if the opcode doesn't exist.									*/
+/*  NULL if the opcode doesn't exist.  A machine opcode's entry is the	*/
+/*  head of its ENCODING.												*/
 
 OPCODE *find_code(char *nam);
 
@@ -94,14 +169,51 @@ void eclose();
 void lopen(char *nam);
 
 
+/*  Listing file hold routine.  Once this is called, lputs() saves the	*/
+/*  listing lines in memory instead of writing them, so that lflag()	*/
+/*  can fill in errors found later.  lclose() writes them out, taking	*/
+/*  the object bytes from the held binary file.							*/
+
+void lhold();
+
+
 /*  Listing file line output routine.  This routine processes the		*/
 /*  source line saved by popc() and the output of the line assembler in	*/
-/*  buffer obj into a line of the listing.  If the disk fills up, a		*/
+/*  buffer obj into rows of the listing for the listing writer.  If	*/
+/*  the disk fills up (which may be found a few rows later), a		*/
 /*  fatal error occurs.													*/
 
 void lputs();
 
 
+/*  Return the number of listing lines held so far.						*/
+
+unsigned long ltell();
+
+
+/*  Set the error code of a held listing line.							*/
+
+void lflag(unsigned long rec, char code);
+
+
+/*  Set the address shown on a held listing line.						*/
+
+void laddr(unsigned long rec, unsigned addr);
+
+
+/*  Listing capture routines, for the pass 2 workers.  Once lkeep() is	*/
+/*  called, lputs() packs the rows of the listing into memory instead	*/
+/*  of handing them to a listing writer.  lkept() returns how many		*/
+/*  bytes of rows are kept, and ltake() hands them over.  lmerge()		*/
+/*  hands rows a worker kept to the listing writer, counting off the	*/
+/*  pages as it goes.													*/
+
+void lkeep();
+size_t lkept();
+char *ltake(size_t *len);
+void lmerge(char *rows, size_t len);
+
+
 /*  Listing file close routine.  The symbol table is appended to the	*/
 /*  listing in alphabetic order by symbol name, and the listing file is	*/
 /*  closed.  If the disk fills up, a fatal error occurs.				*/
@@ -117,6 +229,13 @@ void lclose();
 void bopen(char *nam);
 
 
+/*  Binary file hold routine.  Once this is called, the output is kept	*/
+/*  in memory (whether or not a binary file is open) and written out	*/
+/*  by bclose().														*/
+
+void bhold();
+
+
 /*  Binary file write routine.  The data byte is appended to the output	*/
 /*  buffer.  If the buffer fills up, it gets written to disk. 			*/
 
@@ -129,12 +248,168 @@ void bputc(unsigned c);
 void bpad(unsigned len);
 
 
+/*  Writes len bytes from p to the output file, as bputc() would.		*/
+
+void bwrite(unsigned char *p, unsigned long len);
+
+
+/*  Returns the offset in the output file of the next byte bputc()		*/
+/*  will write.															*/
+
+unsigned long btell();
+
+
+/*  Replaces a byte of the held binary file.							*/
+
+void bpatch(unsigned long offset, unsigned c);
+
+
+/*  Copies bytes of the held binary file back into buffer obj.			*/
+
+void bfetch(unsigned long offset, unsigned len);
+
+
 /*  Binary file close routine. All buffered data is written to disk,	*/
 /*  and the output file is closed.										*/
 
 void bclose();
 
 
+/*  Hands over the held binary file image, setting *len to its length.	*/
+/*  The caller frees it.												*/
+
+unsigned char *btake(unsigned long *len);
+
+
+/*  Relocatable object section routine.  Returns the base number of	*/
+/*  the section named nam, adding it if it's new.			*/
+
+unsigned rsect(char *nam);
+
+
+/*  Relocatable object import routine.  Returns the base number of the	*/
+/*  symbol named nam imported with EXTRN, adding it if it's new.	*/
+
+unsigned rextern(char *nam);
+
+
+/*  Sets the sections up for a pass:  each starts empty, and none has	*/
+/*  a fixed address.							*/
+
+void rstart();
+
+
+/*  Switches the object output to the section with base number tag.	*/
+/*  The location counter *pc is kept for the section being left, and	*/
+/*  set to where the new one left off.  Returns the base the location	*/
+/*  counter is relative to, tag or 0 if the section's address is fixed.	*/
+
+unsigned rswitch(unsigned tag, unsigned *pc);
+
+
+/*  Fixes the address of the section being assembled into at u.	*/
+
+void rorg(unsigned u);
+
+
+/*  Makes the section being assembled into start at a multiple of u	*/
+/*  (as well as of any alignment it already had).  Returns FALSE if	*/
+/*  that can't be done in 64K.						*/
+
+int ralign(unsigned long u);
+
+
+/*  Adds a relocation of the given type to the section being assembled	*/
+/*  into, for the field at offset, whose value is u from base tag.	*/
+
+void rput(unsigned type, unsigned long offset, unsigned tag, unsigned u);
+
+
+/*  Exports a symbol in the object file.  Returns FALSE if the value	*/
+/*  of sym can't be exported (it's imported, or a LOW or HIGH).		*/
+
+int rexport(SYMBOL *sym);
+
+
+/*  Hands over the names of the files this assembly has read, each	*/
+/*  ending with a \0, setting *len to their length, or returns NULL if	*/
+/*  there's no room for them.  The caller frees them.			*/
+
+char *sdeps(size_t *len);
+
+
+/*  Hands over the names of the files this assembly asked for that	*/
+/*  weren't there, each ending with a \0, setting *len to their length,	*/
+/*  or returns NULL if there were none.  The caller frees them.		*/
+
+char *smissing(size_t *len);
+
+
+/*  Dependency file routine.  Writes a make rule to the named file	*/
+/*  saying that the listing, object, and export files depend on every	*/
+/*  file this assembly has read.  If the file doesn't open correctly,	*/
+/*  a fatal error occurs.						*/
+
+void dwrite(char *nam);
+
+
+/*  Snapshot include routine.  Returns TRUE if the symbols of the	*/
+/*  header nam were taken from its snapshot rather than the header	*/
+/*  needing to be read.							*/
+
+int sload(char *nam);
+
+
+/*  Snapshot write routine.  Writes the global symbols the assembly	*/
+/*  defined to a snapshot beside the main source.			*/
+
+void swrite();
+
+
+/*  Output cache look-up routine.  Returns TRUE if the outputs of an	*/
+/*  earlier assembly of the same files with the same options were	*/
+/*  found in the context's cache directory and put in place.		*/
+
+int cfetch();
+
+
+/*  Output cache store routine.  Keeps the outputs of the assembly that	*/
+/*  just finished in the cache for cfetch() to find.			*/
+
+void cstore();
+
+
+/*  Source file open routine.  Returns the cached contents of the named	*/
+/*  file, reading the file the first time, or the first time in this	*/
+/*  assembly that it's found to have changed.  If the file doesn't		*/
+/*  open, NULL is returned.  If the file can't be read, a fatal error	*/
+/*  occurs.																*/
+
+SRCFILE *sopen(char *nam, int binary);
+
+
+/*  Include file reader start-up routine.  Starts a thread that reads	*/
+/*  the files named by the INCL and INCB statements of source sf (and	*/
+/*  of the files it includes) into the cache ahead of the assembly, so	*/
+/*  that sopen() finds them there.  endutil() stops it.					*/
+
+void sreadahead(SRCFILE *sf);
+
+
+/*  Utility package clean-up routine.  Everything the assembly used		*/
+/*  but the source file cache is given back, any files still open are	*/
+/*  closed, and the package is set up for the next assembly.			*/
+
+void endutil();
+
+
+/*  Message output routine.  Error lines (err set) go to the context's	*/
+/*  err stream, other messages to its out stream.  If the stream is		*/
+/*  NULL, the message is added to the context's diag buffer instead.	*/
+
+void say(int err, char *fmt, ...);
+
+
 /*  Error handler routine.  If the current error code is non-blank,		*/
 /*  the error code is filled in and the	number of lines with errors		*/
 /*  is adjusted.														*/
@@ -142,14 +417,22 @@ void bclose();
 void error(char code);
 
 
-/*  Fatal error handler routine.  A message gets printed on the stderr	*/
-/*  device, and the program bombs.										*/
+/*  Fatal error handler routine.  A message gets printed on the stdout	*/
+/*  device, and the assembly bombs back to a65n_assemble().  A message	*/
+/*  kept for later (see A65CTX) is marked with the source's name.	*/
 
 void fatal_error(char *msg);
 
 
+/*  Gives the line a pass 2 worker is on back to the main thread (see	*/
+/*  RUNREC in A65.H):  the worker bombs back to where it started the	*/
+/*  line, with no message.												*/
+
+void handback();
+
+
 /*  Non-fatal error handler routine.  A message gets printed on the		*/
-/*  stderr device, and the routine returns.								*/
+/*  stdout device, and the routine returns.								*/
 
 void warning(char *msg);
 
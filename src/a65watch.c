@@ -0,0 +1,162 @@
+/*
+		      6502 Cross-Assembler in Portable C
+
+		   Copyright (c) 1986 William C. Colley, III
+
+This file contains the watch mode of the a65n command.  It assembles the
+source, then waits for any of the files the assembly read to change and
+assembles it again, for as long as it's left running.  The files are watched
+through the directories they're in, so that editors that save a file by
+writing a new one and renaming it over the old one are caught, too, as is a
+missing include file turning up.  Files that haven't changed stay in the
+source file cache from one assembly to the next, and the listing, object, and
+export files are only replaced once an assembly is done.
+*/
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+/*  Get global goodies:  */
+
+#include "a65.h"
+#include "a65cmd.h"
+
+#ifdef __linux__
+
+#define	SETTLE		10		/*  ms to let a burst of changes end	*/
+#define	EVENTS		(IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | \
+			 IN_MOVED_FROM | IN_MOVED_TO)
+
+/* Static function declarations: */
+static unsigned follow(int fd, A65CTX *ctx);
+static void add(int fd, char *nam);
+static int changed(int fd, int wait);
+
+/*  The files being watched.						*/
+
+static WATCH *wv = NULL;
+static unsigned nwatch = 0, wsize = 0;
+
+void watch(A65CTX *ctx) {
+    SCRATCH int fd, n;
+
+    if ((fd = inotify_init1(IN_CLOEXEC)) < 0) {
+		printf("Fatal Error -- %s\n",NOWATCH);  return;
+    }
+    ctx -> keepdeps = ctx -> atomic = TRUE;
+    for (;;) {
+		if ((n = a65n_assemble(ctx)) > 0) printf("%d Error(s)\n",n);
+		else if (!n) printf("No Errors\n");
+		printf("Watching %u File(s)\n\n",follow(fd,ctx));
+		fflush(stdout);
+		while (changed(fd,-1) <= 0);
+		while (changed(fd,SETTLE) >= 0);
+		a65n_release(ctx);
+    }
+}
+
+/*  Watches the files the assembly in ctx read or found missing, or its	*/
+/*  source if there are none, and stops watching the directories the	*/
+/*  last assembly needed that this one doesn't.  Returns the number of	*/
+/*  files watched.							*/
+
+static unsigned follow(int fd, A65CTX *ctx) {
+    SCRATCH char *p;
+    SCRATCH unsigned i, j, old;
+
+    old = nwatch;
+    for (p = ctx -> deps; p && p < ctx -> deps + ctx -> depslen;
+		p += strlen(p) + 1) add(fd,p);
+    for (p = ctx -> missing; p && p < ctx -> missing + ctx -> missinglen;
+		p += strlen(p) + 1) add(fd,p);
+    if (nwatch == old) add(fd,ctx -> source);
+
+    for (i = 0; i < old; ++i) {
+		for (j = 0; j < i && wv[j].wd != wv[i].wd; ++j);
+		if (j < i) continue;
+		for (j = old; j < nwatch && wv[j].wd != wv[i].wd; ++j);
+		if (j == nwatch) inotify_rm_watch(fd,wv[i].wd);
+    }
+    memmove(wv,wv + old,(nwatch - old) * sizeof(WATCH));
+    return nwatch -= old;
+}
+
+/*  Watches the file nam through the directory it's in.  nam must last	*/
+/*  as long as the watch does.						*/
+
+static void add(int fd, char *nam) {
+    SCRATCH char *p;
+    SCRATCH WATCH *w;
+    SCRATCH int wd;
+    char dir[MAXLINE * 4];
+
+    if ((p = strrchr(nam,'/'))) {
+		if ((size_t)(p - nam) >= sizeof(dir)) return;
+		if (p == nam) strcpy(dir,"/");
+		else { memcpy(dir,nam,p - nam);  dir[p - nam] = '\0'; }
+		++p;
+    }
+    else { strcpy(dir,".");  p = nam; }
+    if ((wd = inotify_add_watch(fd,dir,EVENTS)) < 0) return;
+    if (nwatch == wsize) {
+		wsize = wsize ? wsize * 2 : 16;
+		if (!(wv = (WATCH *)realloc(wv,wsize * sizeof(WATCH)))) {
+			printf("Fatal Error -- %s\n",MEMFULL);  exit(-1);
+		}
+    }
+    w = wv + nwatch++;
+    w -> wd = wd;  w -> name = p;
+    return;
+}
+
+/*  Waits up to wait ms (forever if -1) for something to happen in the	*/
+/*  watched directories.  Returns the number of changes to watched	*/
+/*  files, or -1 if nothing happened in time.				*/
+
+static int changed(int fd, int wait) {
+    SCRATCH struct inotify_event *ev;
+    SCRATCH char *p;
+    SCRATCH ssize_t n;
+    SCRATCH unsigned i;
+    SCRATCH int hit;
+    struct pollfd pf;
+    _Alignas(struct inotify_event) char buf[4096];
+
+    pf.fd = fd;  pf.events = POLLIN;
+    if (poll(&pf,1,wait) <= 0) return -1;
+    if ((n = read(fd,buf,sizeof(buf))) <= 0) {
+		if (n < 0 && errno == EINTR) return 0;
+		printf("Fatal Error -- %s\n",NOWATCH);  exit(-1);
+    }
+    for (hit = 0, p = buf; p < buf + n; p += sizeof(*ev) + ev -> len) {
+		ev = (struct inotify_event *)p;
+		if (ev -> mask & IN_Q_OVERFLOW) ++hit;
+		else if (ev -> len)
+			for (i = 0; i < nwatch; ++i)
+				if (wv[i].wd == ev -> wd && !strcmp(wv[i].name,ev -> name))
+					++hit;
+    }
+    return hit;
+}
+
+#else
+
+/*  Only Linux tells us when files change, so elsewhere there is no	*/
+/*  watch mode.								*/
+
+void watch(A65CTX *ctx) {
+    printf("Fatal Error -- %s\n",NOWATCH);
+    return;
+}
+
+#endif
@@ -0,0 +1,4 @@
+# Runs a batch under make's jobserver:  make -j3 -f batch.mk A65N=a65n
+
+all:
+	-+$(A65N) -m batch.man -j 4
@@ -0,0 +1,4 @@
+;	Board settings
+
+	INCL	"inner.asm"
+BOARD	EQU	REV*16
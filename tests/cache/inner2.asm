@@ -0,0 +1 @@
+REV	EQU	2
@@ -0,0 +1,8 @@
+;	Built with a date stamp, through the cache
+
+	ORG	$0400
+	INCL	"hdr.asm"
+stamp	DATE
+	lda	#BOARD
+	ldx	#LOW stamp
+	END
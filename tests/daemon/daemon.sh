@@ -0,0 +1,29 @@
+#!/bin/sh
+# Daemon round trip:  sh daemon.sh a65n
+#
+# Starts the daemon on a socket of its own and sends it m.asm twice, the
+# second time after a file m.asm includes has changed, then stops it.
+# What the daemon said on starting goes to daemon.out, with the
+# socket's directory written as SOCKET.
+
+a65n=$1
+dir=`mktemp -d` || exit 1
+A65N_SOCKET=$dir/sock
+export A65N_SOCKET
+
+"$a65n" -d > daemon.raw &
+pid=$!
+n=0
+while [ ! -S "$A65N_SOCKET" ] && [ $n -lt 100 ]; do sleep 0.1; n=`expr $n + 1`; done
+
+"$a65n" m.asm -o m.bin -l m.lst > m.out 2> m.err
+echo $? > m.status
+cp inner2.asm inner.asm
+"$a65n" m.asm -o m2.bin -l m2.lst > m2.out 2> m2.err
+echo $? > m2.status
+
+kill $pid
+wait $pid 2> /dev/null
+sed "s|$dir|SOCKET|" daemon.raw > daemon.out
+rm -rf "$dir"
+exit 0
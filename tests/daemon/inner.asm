@@ -0,0 +1 @@
+SPEED	EQU	3
@@ -0,0 +1,9 @@
+;	Assembled by the daemon
+
+	ORG	$0300
+	INCL	"inner.asm"
+table	INCB	"table.bin"
+	lda	#SPEED
+	ldx	table+1
+	MSG	"speed ", SPEED
+	END
@@ -0,0 +1 @@
+PRICE	EQU	$42
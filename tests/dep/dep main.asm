@@ -0,0 +1,9 @@
+;	A source whose files have awkward names
+
+	ORG	$C000
+	INCL	"hdr.asm"
+	INCL	"cost$.asm"
+logo	INCB	"logo#1.bin"
+	lda	#PRICE
+	sta	PORT
+	END
@@ -0,0 +1,4 @@
+;	Ports
+
+	INCL	"inner.asm"
+PORT	EQU	BASE+1
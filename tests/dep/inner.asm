@@ -0,0 +1 @@
+BASE	EQU	$D000
@@ -0,0 +1,48 @@
+        TITL "Test"
+        INCL "inc/hw.asm"
+        ORG $8000
+Reset:  SEI
+        CLD
+        LDX #$FF
+        TXS
+.loop   LDA ZPV
+        STA PPUCTRL
+        LDA FWD1        ; forward EQU chain
+        LDA later
+        LDA (ZPV),Y
+        LDA (ZPV,X)
+        JMP (vec)
+        INC ZPV,X
+        LDX ZPV,Y
+        LDY $1234,X
+        BNE .loop
+        ASL A
+        ROR A
+        BIT $44
+        CPX #3
+        STX $10,Y
+        JSR Sub
+        IF 0
+        LDA bogus junk line $$$
+        DB 1,2,3
+        ELSE
+        DB 4,5,HIGH(Reset+3*3),LOW Reset
+        ENDI
+        DW Reset, Sub, $1234
+        DB "hello",0
+        DB 1 < 2, 3 >= 3, 5 MOD 3, 1 SHL 4, $F0 AND $3C, NOT 0
+cnt     SET 1
+cnt     SET cnt+1
+        DB cnt
+        ALIGN 16
+Sub:    RTS
+.loop   NOP
+        BEQ .loop
+vec     DW Reset
+later   EQU $0005
+        INCB "inc/data.bin"
+        RMB 3
+        EXP Reset
+        ORG $FFFA
+        DW Reset, Reset, Reset
+        END
@@ -0,0 +1,25 @@
+	ORG	$C000
+	lda	Undefined
+	lda	#$1234
+	bne	Far
+	xyz	1
+	lda	(1,y)
+Dup:	nop
+Dup:	nop
+A	nop
+	lda	1,2,3
+	DB	"unterminated
+	lda	($12
+	DB	3+ 12G
+	ENDI
+	IF	Fwd
+	ENDI
+Fwd	EQU	1
+	DW	Nope+$1234, $1234+Nope
+	DB	Nope+2, (Nope+3)
+	lda	#Nope+5
+Nope2	EQU	Nope+7
+	ORG	$C200
+Far:	rts
+	lda	9Q
+	INCL	"nonexistent"
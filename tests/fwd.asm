@@ -0,0 +1,25 @@
+	ORG	$E000
+	lda	(Zp),y
+	lda	(Big),y
+	lda	#Big
+	lda	#HIGH Big
+	ldx	Zp,y
+	stx	Zp,y
+	jmp	(Vec)
+	bne	Far
+	beq	Near
+	DW	Vec, Big+1, *
+	DB	Near-*, LOW Vec
+	EXP	Vec
+Dup	nop
+Dup	nop
+Near	lda	Nope
+	MSG	"fwd ", Near
+	DB	1,Nope2,3
+Zp	EQU	$20
+Big	EQU	$1234
+Vec	DW	Near
+	ORG	$E100
+Far	rts
+	EXP	Far
+	END
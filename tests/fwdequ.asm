@@ -0,0 +1,18 @@
+;	EQUs that refer forward, in chains
+
+	ORG	$1000
+VA	EQU	VB+1
+VB	EQU	VC+1
+ZP	EQU	ZBASE+2
+	lda	VB
+	lda	VA
+	sta	ZP
+	DW	VA, VB-VC
+	DB	LOW VA, ZP
+	bne	VC
+	EXP	VA
+VC	nop
+ZBASE	EQU	$40
+HERE	EQU	*
+	EXP	ZP
+	END
@@ -0,0 +1,137 @@
+# Golden output test, run by ctest as cmake -P tests/golden.cmake.
+#
+#   RUN    commands to run one after another in the tests directory,
+#          separated by "&&".  @WORK@ in an argument is replaced by
+#          WORK, the test's own output directory, and "cd dir" runs
+#          the commands after it in dir instead.  Command n's standard
+#          output, error output, and exit code go to WORK/stdout<n>,
+#          WORK/stderr<n>, and WORK/status<n>.  "ls dir" counts as a
+#          command whose output is the names of the files in dir, one
+#          to a line, in order.
+#   CHECK  file=expected pairs.  Each file made in WORK must match the
+#          expected one byte for byte:  a file in tests/expect, a file
+#          in WORK (@WORK@/name), or sha256:<hash> of the contents.
+#   BIG    if set, WORK/big.asm is made first (see below).
+#
+# Lists come in with "|" in place of ";".
+
+cmake_minimum_required(VERSION 3.18)
+
+get_filename_component(SRC "${CMAKE_CURRENT_LIST_DIR}" ABSOLUTE)
+string(REPLACE "|" ";" RUN "${RUN}")
+string(REPLACE "|" ";" CHECK "${CHECK}")
+file(REMOVE_RECURSE "${WORK}")
+file(MAKE_DIRECTORY "${WORK}")
+
+# A source of several thousand lines, long enough for -j to share pass 2
+# out among threads in runs of 4096 lines.  It sticks to what the
+# original assembler knew, and has forward references, local labels,
+# SET labels, MSG, errors, and skipped IF blocks scattered through it.
+if(BIG)
+    set(n 1800)
+    set(text "\tORG\t$0200\nC\tSET\t0\n")
+    math(EXPR last "${n} - 1")
+    foreach(i RANGE ${last})
+        math(EXPR next "(${i} + 1) % ${n}")
+        math(EXPR call "(${i} + 7) % ${n}")
+        math(EXPR zp "${i} % 50")
+        math(EXPR byte "${i} % 256")
+        string(APPEND text
+            "B${i}:\tlda\t#${byte}\n"
+            ".l\tsta\t$10,x\n"
+            "\tlda\tT${next},x\n"
+            "\tbne\t.l\n"
+            "\tjsr\tB${call}\n"
+            "\tldx\tZ${zp}\n"
+            "T${i}\tDW\tB${i}, T${i}+1\n"
+            "\tDB\t${byte}, LOW T${i}, \"ab\"\n")
+        math(EXPR m "${i} % 97")
+        if(m EQUAL 0)
+            string(APPEND text "C\tSET\tC+1\n\tDB\tC\n")
+        endif()
+        math(EXPR m "${i} % 211")
+        if(m EQUAL 0)
+            string(APPEND text "\tMSG\t\"block \", ${i}, \" at \", T${i}\n")
+        endif()
+        math(EXPR m "${i} % 157")
+        if(m EQUAL 0)
+            string(APPEND text "\tlda\t#300\n")
+        endif()
+        math(EXPR m "${i} % 400")
+        if(m EQUAL 0)
+            string(APPEND text "\tIF\t0\n\tDB\t9, 9, 9\n\tELSE\n\tlda\t#1\n\tENDI\n")
+        endif()
+    endforeach()
+    foreach(i RANGE 49)
+        math(EXPR v "${i} + 16")
+        string(APPEND text "Z${i}\tEQU\t${v}\n")
+    endforeach()
+    string(APPEND text "\tEND\n")
+    file(WRITE "${WORK}/big.asm" "${text}")
+endif()
+
+set(step 0)
+set(cmd "")
+set(dir "${SRC}")
+list(APPEND RUN "&&")
+foreach(arg IN LISTS RUN)
+    if(arg STREQUAL "&&" AND cmd MATCHES "^cd;(.*)")
+        set(dir "${CMAKE_MATCH_1}")
+        set(cmd "")
+    elseif(arg STREQUAL "&&" AND cmd MATCHES "^ls;(.*)")
+        math(EXPR step "${step} + 1")
+        file(GLOB names RELATIVE "${dir}/${CMAKE_MATCH_1}"
+            "${dir}/${CMAKE_MATCH_1}/*")
+        list(SORT names)
+        list(JOIN names "\n" names)
+        file(WRITE "${WORK}/stdout${step}" "${names}\n")
+        file(WRITE "${WORK}/stderr${step}" "")
+        file(WRITE "${WORK}/status${step}" "0\n")
+        set(cmd "")
+    elseif(arg STREQUAL "&&")
+        math(EXPR step "${step} + 1")
+        execute_process(COMMAND ${cmd}
+            WORKING_DIRECTORY "${dir}"
+            OUTPUT_FILE "${WORK}/stdout${step}"
+            ERROR_FILE "${WORK}/stderr${step}"
+            RESULT_VARIABLE status)
+        file(WRITE "${WORK}/status${step}" "${status}\n")
+        set(cmd "")
+    else()
+        string(REPLACE "@WORK@" "${WORK}" arg "${arg}")
+        list(APPEND cmd "${arg}")
+    endif()
+endforeach()
+
+set(failed FALSE)
+foreach(pair IN LISTS CHECK)
+    string(REPLACE "=" ";" pair "${pair}")
+    list(GET pair 0 file)
+    list(GET pair 1 expected)
+    set(made "${WORK}/${file}")
+    if(NOT EXISTS "${made}")
+        message(SEND_ERROR "${file}: not made")
+        set(failed TRUE)
+    elseif(expected MATCHES "^sha256:(.*)")
+        set(hash "${CMAKE_MATCH_1}")
+        file(SHA256 "${made}" got)
+        if(NOT got STREQUAL hash)
+            message(SEND_ERROR "${file}: sha256 ${got}, expected ${hash}")
+            set(failed TRUE)
+        endif()
+    else()
+        string(REPLACE "@WORK@" "${WORK}" expected "${expected}")
+        if(NOT IS_ABSOLUTE "${expected}")
+            set(expected "${SRC}/expect/${expected}")
+        endif()
+        execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files
+            "${made}" "${expected}" RESULT_VARIABLE differ)
+        if(differ)
+            message(SEND_ERROR "${file} differs from ${expected}")
+            set(failed TRUE)
+        endif()
+    endif()
+endforeach()
+if(failed)
+    message(FATAL_ERROR "output in ${WORK} doesn't match")
+endif()
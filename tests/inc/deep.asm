@@ -0,0 +1,2 @@
+DEEP	EQU	7
+	ldy	#DEEP
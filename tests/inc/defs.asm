@@ -0,0 +1,6 @@
+; included definitions
+DEFV	EQU	$42
+Incl:	lda	DEFV
+.a	lda	.a
+	INCL	"inc/deep.asm"
+	rts
@@ -0,0 +1,4 @@
+;	Animation frames
+
+FRAMES	EQU	3
+frames	DB	FRAMES, 1, 2, 3
@@ -0,0 +1,7 @@
+; hardware header
+PPUCTRL  EQU $2000
+PPUMASK  EQU $2001
+ZPV      EQU $10
+FWD1     EQU FWD2+1
+FWD2     EQU $0030
+; x
@@ -0,0 +1,6 @@
+;	Sprite shapes
+
+SHAPES	EQU	4
+shape	lda	#SHAPES
+	INCB	"inc/data.bin"
+	INCL	"inc/frames.asm"
@@ -0,0 +1,19 @@
+;	Include files read ahead of the assembler, and a listing of
+;	several pages
+	TITL	"Include files"
+	PAGE	24
+	ORG	$2000
+start	INCL	"inc/defs.asm"
+	IF	0
+	INCL	"inc/absent.asm"
+	INCB	"inc/absent.bin"
+	ENDI
+	IF	DEFV
+	INCL	"inc/shape.asm"
+	ENDI
+	TITL	"Tables"
+blob	INCB	"inc/blob.bin"
+	DW	blob, shape, start
+	INCB	"inc/data.bin"
+	jmp	start
+	END
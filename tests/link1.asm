@@ -0,0 +1,12 @@
+        EXTRN Sub2
+        EXP Main
+        SECT "CODE"
+Main:   JSR Sub2
+        LDA #LOW Sub2
+        LDX #HIGH Sub2
+        LDA tbl,X
+        BNE Main
+        RTS
+tbl     DB 1,2,3
+        DW Main
+        END
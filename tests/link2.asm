@@ -0,0 +1,5 @@
+        EXP Sub2
+        SECT "LIB",16
+Sub2:   LDA #1
+        RTS
+        END
@@ -0,0 +1,95 @@
+; regression source
+	TITL	"Regression test"
+	PAGE	40
+ZP1	EQU	$10
+ZP2	EQU	ZP1+2
+BIGV	EQU	$1234
+CNT	SET	1
+CNT	SET	CNT+1
+	ORG	$8000
+Reset:
+	sei
+	cld
+	ldx	#$FF
+	txs
+	lda	#<BIGV
+	lda	#HIGH BIGV
+	lda	#LOW(Later+3)
+	lda	ZP1
+	lda	ZP1,x
+	lda	BIGV,x
+	lda	BIGV,y
+	lda	(ZP1,x)
+	lda	(ZP2),y
+	lda	!ZP1
+	sta	Later
+	sta	Later,x
+	stx	ZP1,y
+	sty	ZP1,x
+	stx	ZP1
+	ldx	ZP1,y
+	ldx	BIGV,y
+	ldy	BIGV,x
+	cpx	#3
+	cpy	ZP1
+	cpx	BIGV
+	bit	ZP1
+	bit	BIGV
+	asl	a
+	asl	ZP1
+	rol	BIGV,x
+	lsra
+	inc	ZP1
+	dec	BIGV,x
+	jmp	(Vec)
+	jmp	Later
+	jsr	Sub
+.loop:
+	dex
+	bne	.loop
+	beq	.fwd
+	nop
+.fwd:	rts
+	lda	(ZP1+1)*2
+	lda	(ZP1)+1,x
+	lda	#"A"
+	lda	#'AB'&$ff
+	lda	#CNT
+	IF	CNT EQ 2
+	lda	#1
+	IF	0
+	lda	#2
+	ELSE
+	lda	#3
+	ENDI
+	ELSE
+	lda	#4
+	ENDI
+	INCL	"inc/defs.asm"
+	lda	#DEFV
+Sub:
+	adc	#1
+	sbc	(ZP1),y
+	and	ZP1
+	ora	BIGV
+	eor	ZP1,x
+	cmp	#$FF80
+	rts
+Later:	DB	1,2,3,"hello",0, -1, Later & $ff, HIGH Later
+	DW	Later, Reset, $1234, , 5
+Vec:	DW	Reset
+	ALIGN	$10
+	DB	2*3+4, 7 MOD 3, 1 SHL 4, $F0 SHR 4, NOT 0 AND $FF, 3 OR 4 XOR 1
+	DB	2 LT 3, 3 GT 2, 2 LE 2, 2 GE 3, 2 NE 2, 2 = 2, 2 <> 3, 2 <= 3, 3 >= 2
+	DB	%1010, @17, 0FFH, 377Q, 11B, 99D, $ab
+	INCB	"inc/data.bin"
+	MSG	"Later is ", Later, " size ", Later - Reset
+	EXP	Later
+	EXP	Reset
+Rmbl	RMB	4
+	ORG	$8100
+Other:	lda	Other.x
+Other.x	EQU	5
+	ldx	Reset.loop
+	bmi	Reset.fwd
+	END
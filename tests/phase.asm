@@ -0,0 +1,20 @@
+	ORG $10
+V	SET 1
+V	SET V+1
+	lda V
+	DB V, Z, "ab"
+	ORG FWD
+	lda Z
+	sta Q,x
+Z	EQU $20
+	jmp Z
+	bne far
+	ldx #300
+	lda (Z),y
+	inc
+FWD	EQU $2000
+far	nop
+Q	DW far, V, *
+	lda Y
+Y	EQU Z+1
+	END
@@ -0,0 +1,31 @@
+        ORG $8000
+Reset:  JSR Used
+        JMP Reset
+Used    PROC
+        LDA #1
+        JSR Inner
+        RTS
+        ENDPROC
+Unused  PROC
+        LDA #2
+.x      JMP .x
+        RTS
+        ENDPROC
+Inner   PROC
+        LDA tbl
+        RTS
+tbl     DB 1
+        ENDPROC
+Nmi     PROC
+        RTI
+        ENDPROC
+Kept    PROC
+        RTS
+        ENDPROC
+        KEEP Kept
+After   LDA #3
+        EXP After
+        EXP Unused
+        ORG $FFFA
+        DW Nmi, Reset, Reset
+        END
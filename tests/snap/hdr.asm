@@ -0,0 +1,6 @@
+;	Hardware registers, kept as a symbol snapshot
+
+	INCL	"inner.asm"
+VIA2	EQU	VIA1+$10
+PORTB	EQU	VIA1
+REV	SET	1
@@ -0,0 +1,4 @@
+;	Base addresses
+
+VIA1	EQU	$6000
+ACIA	EQU	$5000
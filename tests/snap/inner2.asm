@@ -0,0 +1,4 @@
+;	Base addresses, as moved on the new board
+
+VIA1	EQU	$7000
+ACIA	EQU	$5000
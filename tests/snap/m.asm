@@ -0,0 +1,9 @@
+;	Uses the header through its snapshot
+
+	ORG	$0800
+	INCL	"hdr.asm"
+	lda	#REV
+	sta	VIA2
+	sta	PORTB
+	lda	ACIA
+	END